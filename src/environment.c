@@ -59,22 +59,360 @@ static int ExecuteSystem(const char *call,
 		Instruction *args, Uint32 numArgs, Value *result);
 int function_Execute(Function *func,
 		Instruction *args, Uint32 numArgs, Value *result);
+static int ExecuteNamed(const char *name, Function *func,
+		Instruction *args, Uint32 numArgs, Value *result);
 static int EvaluateInstruction(Instruction *instr, Value *value);
 static int ExecuteInstructions(Instruction *instrs,
 		Uint32 num, Value *value);
+static Value *EvaluateArguments(Instruction *args, Uint32 numArgs);
+
+/* allocations owned by the collector carry a tag in the lower bits of
+ * their flags, untagged allocations (labels, the stack) are never swept */
+#define GC_TAG(type) (1 + (Uint64) (type))
+/* payload of a string, array or success value */
+#define GC_DATA 0xff
+#define GC_TAG_MASK 0xff
+#define GC_COLOR ((Uint64) 1 << 63)
+/* how many steps are done before looking at the clock again */
+#define GC_CHECK 64
+#define GC_MIN_THRESHOLD 65536
+
+static struct gc {
+	enum {
+		GC_IDLE,
+		GC_MARK,
+		GC_SWEEP,
+	} phase;
+	/* the color bit marked allocations have, it flips every cycle
+	 * so that the sweep never has to clear anything */
+	Uint64 black;
+	Uint32 cycle;
+	bool failed;
+	Value *gray;
+	Uint32 numGray;
+	Uint32 capGray;
+	Uint32 sweep;
+	/* entries below the sweep cursor that are not holes, this is where
+	 * the cursor is after freeing compacted the union */
+	Uint32 kept;
+	Size threshold;
+	Uint64 numCollected;
+	/* containers the collector did not allocate (like the ones of the
+	 * parser) have no color, this set of the ones scanned in the
+	 * current pass makes cycles through them end */
+	const void **foreign;
+	Uint32 numForeign;
+	Uint32 capForeign;
+} gc = {
+	.threshold = GC_MIN_THRESHOLD,
+};
+
+/* new allocations are white while marking (the final root scan finds
+ * them if they are reachable) and black while sweeping so that they
+ * survive */
+static void *GCAlloc(Size sz, Uint64 tag)
+{
+	Uint64 color;
+
+	color = gc.phase == GC_MARK ? gc.black ^ GC_COLOR : gc.black;
+	return union_Allocf(environment.uni, sz, tag | color);
+}
+
+/* gives a container its first buffer, the container may already be
+ * scanned (black or not allocated by the collector) and nothing would
+ * mark a white buffer, so it is black like during sweeping */
+static void *GCRealloc(void *ptr, Size sz)
+{
+	if (ptr == NULL) {
+		return union_Allocf(environment.uni, sz, GC_DATA | gc.black);
+	}
+	return union_Realloc(environment.uni, ptr, sz);
+}
+
+enum gc_mark {
+	/* not allocated by the collector, see gc.foreign */
+	GC_MARK_FOREIGN,
+	GC_MARK_BLACK,
+	GC_MARK_NEW,
+};
+
+static enum gc_mark GCMark(const void *ptr)
+{
+	struct mem_ptr *const mp = union_Find(environment.uni, ptr);
+
+	if (mp == NULL || !(mp->flags & GC_TAG_MASK)) {
+		return GC_MARK_FOREIGN;
+	}
+	if ((mp->flags & GC_COLOR) == gc.black) {
+		return GC_MARK_BLACK;
+	}
+	mp->flags ^= GC_COLOR;
+	return GC_MARK_NEW;
+}
+
+static Uint32 GCHashForeign(const void *ptr)
+{
+	return (Uint32) (((uintptr_t) ptr >> 4) * 2654435761u);
+}
+
+static void GCClearForeign(void)
+{
+	if (gc.foreign != NULL) {
+		memset(gc.foreign, 0, sizeof(*gc.foreign) * gc.capForeign);
+	}
+	gc.numForeign = 0;
+}
+
+/* returns whether a foreign container is scanned for the first time in
+ * this pass */
+static bool GCVisitForeign(const void *ptr)
+{
+	const void **newForeign;
+	const void **old;
+	Uint32 oldCap, mask, slot;
+
+	if ((gc.numForeign + 1) * 2 > gc.capForeign) {
+		old = gc.foreign;
+		oldCap = gc.capForeign;
+		newForeign = union_Alloc(union_Default(), sizeof(*newForeign) *
+				(oldCap * 2 + 64));
+		if (newForeign == NULL) {
+			/* the cycle is abandoned, nothing gets swept */
+			gc.failed = true;
+			return false;
+		}
+		gc.foreign = newForeign;
+		gc.capForeign = oldCap * 2 + 64;
+		GCClearForeign();
+		for (Uint32 i = 0; i < oldCap; i++) {
+			if (old[i] != NULL) {
+				GCVisitForeign(old[i]);
+			}
+		}
+		if (old != NULL) {
+			union_Free(union_Default(), old);
+		}
+	}
+	mask = gc.capForeign - 1;
+	for (slot = GCHashForeign(ptr) & mask; gc.foreign[slot] != NULL;
+			slot = (slot + 1) & mask) {
+		if (gc.foreign[slot] == ptr) {
+			return false;
+		}
+	}
+	gc.foreign[slot] = ptr;
+	gc.numForeign++;
+	return true;
+}
+
+/* whether the values of a container have to be scanned */
+static bool GCMarkContainer(const void *ptr)
+{
+	switch (GCMark(ptr)) {
+	case GC_MARK_FOREIGN:
+		return GCVisitForeign(ptr);
+	case GC_MARK_NEW:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void GCPush(const Value *value)
+{
+	Value *newGray;
+
+	switch (value->type) {
+	case TYPE_ARRAY:
+	case TYPE_FUNCTION:
+	case TYPE_STRING:
+	case TYPE_SUCCESS:
+	case TYPE_VIEW:
+		break;
+	default:
+		return;
+	}
+	if (gc.numGray == gc.capGray) {
+		newGray = union_Realloc(union_Default(), gc.gray,
+				sizeof(*gc.gray) * (gc.capGray * 2 + 64));
+		if (newGray == NULL) {
+			/* the cycle is abandoned, nothing gets swept */
+			gc.failed = true;
+			return;
+		}
+		gc.gray = newGray;
+		gc.capGray = gc.capGray * 2 + 64;
+	}
+	gc.gray[gc.numGray++] = *value;
+}
+
+static void GCScanView(View *view)
+{
+	view->gcCycle = gc.cycle;
+	/* the default view has no values of its own */
+	if (view->values == NULL) {
+		return;
+	}
+	for (Uint32 i = 0; i < view->label->numProperties; i++) {
+		GCPush(&view->values[i]);
+	}
+}
+
+static void GCScan(const Value *value)
+{
+	switch (value->type) {
+	case TYPE_ARRAY:
+		if (GCMarkContainer(value->a)) {
+			GCMark(value->a->values);
+			for (Uint32 i = 0; i < value->a->numValues; i++) {
+				GCPush(&value->a->values[i]);
+			}
+		}
+		break;
+	case TYPE_FUNCTION:
+		GCMark(value->func);
+		break;
+	case TYPE_STRING:
+		if (GCMarkContainer(value->s)) {
+			GCMark(value->s->data);
+		}
+		break;
+	case TYPE_SUCCESS:
+		GCMark(value->succ.id);
+		GCMark(value->succ.content);
+		break;
+	case TYPE_VIEW:
+		if (value->v != NULL && value->v->gcCycle != gc.cycle) {
+			GCScanView(value->v);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void GCPushViews(View *view)
+{
+	for (; view != NULL; view = view->next) {
+		GCScanView(view);
+		GCPushViews(view->child);
+	}
+}
+
+static void GCPushRoots(void)
+{
+	for (Label *label = environment.label; label != NULL;
+			label = label->next) {
+		for (Uint32 i = 0; i < label->numProperties; i++) {
+			GCPush(&label->properties[i].value);
+		}
+	}
+	GCPushViews(view_Default());
+	for (Uint32 i = 0; i < environment.numStack; i++) {
+		GCPush(&environment.stack[i].value);
+	}
+}
 
-/*static void environment_GC(void)
+/* a value is stored somewhere that might already be scanned */
+static void GCBarrier(const Value *value)
+{
+	if (gc.phase == GC_MARK) {
+		GCPush(value);
+	}
+}
+
+static void GCStep(void)
 {
-	* free unused pointers *
 	Union *const uni = environment.uni;
-	for (Uint32 i = 0; uni->numPointers; i++) {
-		struct mem_ptr *const ptr = &uni->pointers[i];
-		if ((type_t) ptr->flags == TYPE_NULL) {
-			continue;
+	struct mem_ptr *mp;
+	Value value;
+
+	if (gc.failed) {
+		gc.failed = false;
+		gc.numGray = 0;
+		gc.phase = GC_IDLE;
+		return;
+	}
+	switch (gc.phase) {
+	case GC_IDLE:
+		break;
+	case GC_MARK:
+		/* scanning pushes over the slot of the value, so it is
+		 * copied out first */
+		if (gc.numGray > 0) {
+			value = gc.gray[--gc.numGray];
+			GCScan(&value);
+			break;
+		}
+		/* the roots may have changed since the cycle started,
+		 * scanning them again finishes marking in one go, foreign
+		 * containers have no color to stop at and are scanned again */
+		GCClearForeign();
+		GCPushRoots();
+		while (gc.numGray > 0 && !gc.failed) {
+			value = gc.gray[--gc.numGray];
+			GCScan(&value);
+		}
+		if (!gc.failed) {
+			gc.phase = GC_SWEEP;
+			gc.sweep = 0;
+			gc.kept = 0;
+		}
+		break;
+	case GC_SWEEP:
+		if (gc.sweep >= uni->numPointers) {
+			gc.threshold = MAX(uni->allocated * 2,
+					(Size) GC_MIN_THRESHOLD);
+			gc.phase = GC_IDLE;
+			break;
+		}
+		mp = &uni->pointers[gc.sweep];
+		if (mp->sys != NULL && (mp->flags & GC_TAG_MASK) &&
+				(mp->flags & GC_COLOR) != gc.black) {
+			union_Free(uni, mp->sys);
+			gc.numCollected++;
+			/* no holes left means the union was compacted (or
+			 * there were none below the cursor) */
+			if (uni->numHoles == 0) {
+				gc.sweep = gc.kept;
+			}
+		} else {
+			if (mp->sys != NULL) {
+				gc.kept++;
+			}
+			gc.sweep++;
 		}
+		break;
+	}
+}
 
+void environment_GC(Uint32 budget)
+{
+	Uint64 deadline = 0;
+
+	if (gc.phase == GC_IDLE) {
+		if (budget != 0 && environment.uni->allocated < gc.threshold) {
+			return;
+		}
+		gc.cycle++;
+		gc.black ^= GC_COLOR;
+		gc.numGray = 0;
+		gc.phase = GC_MARK;
+		GCClearForeign();
+		GCPushRoots();
+	}
+	if (budget != 0) {
+		deadline = SDL_GetPerformanceCounter() + (Uint64) budget *
+			SDL_GetPerformanceFrequency() / 1000000;
 	}
-}*/
+	for (Uint32 n = 1; gc.phase != GC_IDLE; n++) {
+		if (budget != 0 && n % GC_CHECK == 0 &&
+				SDL_GetPerformanceCounter() >= deadline) {
+			break;
+		}
+		GCStep();
+	}
+}
 
 Uint32 utf8_Next(const char *str, Uint32 length, Uint32 index)
 {
@@ -317,6 +655,30 @@ static int GetSubVariable(Value *value, const char *sub, Value *result)
 	return 0;
 }
 
+/* a store may change what views draw: locals change nothing, a
+ * property of the current view repaints it and anything else may be
+ * read by any view; stores while painting (a counter in a draw function)
+ * damage nothing or the loop would never idle */
+static void InvalidateStore(const Property *var)
+{
+	View *const view = environment.view;
+
+	if (gui_IsPainting()) {
+		return;
+	}
+	if (var >= environment.stack &&
+			var < environment.stack + environment.numStack) {
+		return;
+	}
+	if (view != NULL && var >= view->label->properties &&
+			var < view->label->properties +
+				view->label->numProperties) {
+		view_Invalidate(view);
+		return;
+	}
+	view_InvalidateAll();
+}
+
 static int SetSubVariable(Value *value, const char *sub, Value *result)
 {
 	Value actual;
@@ -420,16 +782,21 @@ static int SetSubVariable(Value *value, const char *sub, Value *result)
 		}
 		break;
 
-	case TYPE_VIEW:
-		if (_SearchVariable(value->v, sub, &value) == NULL) {
+	case TYPE_VIEW: {
+		View *const view = value->v;
+
+		if (_SearchVariable(view, sub, &value) == NULL) {
 			return -1;
 		}
 		if (value_Cast(result, value->type, &actual) < 0) {
 			return -1;
 		}
 		*value = actual;
+		GCBarrier(&actual);
+		view_Invalidate(view);
 		break;
 	}
+	}
 	return 0;
 }
 
@@ -449,14 +816,14 @@ static int StandardProc(View *view, event_t event, EventInfo *info)
 		if (value == NULL) {
 			break;
 		}
-		function_Execute(value->func, NULL, 0, &v);
+		ExecuteNamed("init", value->func, NULL, 0, &v);
 		break;
 	case EVENT_PAINT:
 		value = view_GetProperty(view, TYPE_FUNCTION, "draw");
 		if (value == NULL) {
 			break;
 		}
-		function_Execute(value->func, NULL, 0, &v);
+		ExecuteNamed("draw", value->func, NULL, 0, &v);
 		break;
 	default:
 		value = view_GetProperty(view, TYPE_FUNCTION, "event");
@@ -468,14 +835,14 @@ static int StandardProc(View *view, event_t event, EventInfo *info)
 		v.e.event = event;
 		v.e.info = *info;
 		i.value.value = v;
-		function_Execute(value->func, &i, 1, &v);
+		ExecuteNamed("event", value->func, &i, 1, &v);
 		break;
 	}
 	environment.view = prev;
 	return 0;
 }
 
-int function_Execute(Function *func, Instruction *args, Uint32 numArgs,
+static int CallFunction(Function *func, Instruction *args, Uint32 numArgs,
 		Value *result)
 {
 	Property *newStack;
@@ -525,6 +892,27 @@ int function_Execute(Function *func, Instruction *args, Uint32 numArgs,
 	return 0;
 }
 
+/* name is what the function was called by, for tracing */
+static int ExecuteNamed(const char *name, Function *func,
+		Instruction *args, Uint32 numArgs, Value *result)
+{
+	frame_phase_t phase;
+	int r;
+
+	phase = gui_EnterPhase(FRAME_PHASE_SCRIPT);
+	trace_Begin("script", name, NULL);
+	r = CallFunction(func, args, numArgs, result);
+	trace_End();
+	gui_EnterPhase(phase);
+	return r;
+}
+
+int function_Execute(Function *func, Instruction *args, Uint32 numArgs,
+		Value *result)
+{
+	return ExecuteNamed("function", func, args, numArgs, result);
+}
+
 static bool Equals(const Value *v1, const Value *v2)
 {
 	switch (v1->type) {
@@ -627,8 +1015,8 @@ static int EvaluateInstruction(Instruction *instr, Value *result)
 					instr->invoke.numArgs, result) < 0) {
 				return -1;
 			}
-		} else if (function_Execute(var->value.func,
-					instr->invoke.args,
+		} else if (ExecuteNamed(instr->invoke.name,
+					var->value.func, instr->invoke.args,
 					instr->invoke.numArgs, result) < 0) {
 			return -1;
 		}
@@ -643,7 +1031,8 @@ static int EvaluateInstruction(Instruction *instr, Value *result)
 		if (result->type != TYPE_FUNCTION) {
 			return -1;
 		}
-		if (function_Execute(result->func, instr->invokesub.args,
+		if (ExecuteNamed(instr->invokesub.sub, result->func,
+					instr->invokesub.args,
 					instr->invokesub.numArgs, result) < 0) {
 			return -1;
 		}
@@ -818,7 +1207,8 @@ int instruction_Execute(Instruction *instr, Value *result)
 		if (result->type != TYPE_FUNCTION) {
 			return -1;
 		}
-		if (function_Execute(result->func, instr->invokesub.args,
+		if (ExecuteNamed(instr->invokesub.sub, result->func,
+					instr->invokesub.args,
 					instr->invokesub.numArgs, result) < 0) {
 			return -1;
 		}
@@ -870,6 +1260,8 @@ int instruction_Execute(Instruction *instr, Value *result)
 			} else {
 				var->value = out;
 			}
+			GCBarrier(&out);
+			InvalidateStore(var);
 		} else if (instr->set.dest->instr == INSTR_SUBVARIABLE) {
 			if (EvaluateInstruction(instr->set.dest->subvariable.from, &val) < 0) {
 				return -1;
@@ -915,6 +1307,7 @@ int instruction_Execute(Instruction *instr, Value *result)
 
 	case INSTR_TRIGGER: {
 		struct trigger *trigger;
+		Value *values;
 
 		/* triggers are just system functions but defined
 		 * by the user in C and installed using
@@ -923,14 +1316,15 @@ int instruction_Execute(Instruction *instr, Value *result)
 		if (trigger == NULL) {
 			return -1;
 		}
-		Value values[instr->trigger.numArgs];
-		for (Uint32 i = 0; i < instr->trigger.numArgs; i++) {
-			if (EvaluateInstruction(&instr->trigger.args[i],
-						&values[i]) < 0) {
-				return -1;
-			}
+		values = EvaluateArguments(instr->trigger.args,
+				instr->trigger.numArgs);
+		if (values == NULL && instr->trigger.numArgs > 0) {
+			return -1;
 		}
 		trigger->trigger(values, instr->trigger.numArgs, result);
+		if (values != NULL) {
+			union_Free(union_Frame(), values);
+		}
 		break;
 	}
 
@@ -942,8 +1336,8 @@ int instruction_Execute(Instruction *instr, Value *result)
 					instr->invoke.numArgs, result) < 0) {
 				return -1;
 			}
-		} else if (function_Execute(var->value.func,
-					instr->invoke.args,
+		} else if (ExecuteNamed(instr->invoke.name,
+					var->value.func, instr->invoke.args,
 					instr->invoke.numArgs, result) < 0) {
 			return -1;
 		}
@@ -991,6 +1385,28 @@ static int ExecuteInstructions(Instruction *instrs,
 	return 0;
 }
 
+/* the values live in the frame union, arguments are evaluated before the
+ * call so nested calls free theirs first and each free is a pop */
+static Value *EvaluateArguments(Instruction *args, Uint32 numArgs)
+{
+	Value *values;
+
+	if (numArgs == 0) {
+		return NULL;
+	}
+	values = union_Alloc(union_Frame(), sizeof(*values) * numArgs);
+	if (values == NULL) {
+		return NULL;
+	}
+	for (Uint32 i = 0; i < numArgs; i++) {
+		if (EvaluateInstruction(&args[i], &values[i]) < 0) {
+			union_Free(union_Frame(), values);
+			return NULL;
+		}
+	}
+	return values;
+}
+
 static int SystemAnd(const Value *args, Uint32 numArgs, Value *result)
 {
 	result->type = TYPE_BOOL;
@@ -1047,14 +1463,14 @@ static int SystemDup(const Value *args, Uint32 numArgs, Value *result)
 	case TYPE_ARRAY: {
 		struct value_array *arr;
 
-		arr = union_Alloc(environment.uni, sizeof(*arr));
+		arr = GCAlloc(sizeof(*arr), GC_TAG(TYPE_ARRAY));
 		if (arr == NULL) {
 			return -1;
 		}
 		arr->numValues = args[0].a->numValues;
 		if (arr->numValues != 0) {
-			arr->values = union_Alloc(environment.uni,
-					sizeof(*arr->values) * arr->numValues);
+			arr->values = GCAlloc(sizeof(*arr->values) *
+					arr->numValues, GC_DATA);
 			if (arr->values == NULL) {
 				return -1;
 			}
@@ -1070,13 +1486,13 @@ static int SystemDup(const Value *args, Uint32 numArgs, Value *result)
 	case TYPE_STRING: {
 		struct value_string *str;
 
-		str = union_Alloc(environment.uni, sizeof(*str));
+		str = GCAlloc(sizeof(*str), GC_TAG(TYPE_STRING));
 		if (str == NULL) {
 			return -1;
 		}
 		str->length = args[0].s->length;
 		if (str->length != 0) {
-			str->data = union_Alloc(environment.uni, str->length);
+			str->data = GCAlloc(str->length, GC_DATA);
 			if (str->data == NULL) {
 				return -1;
 			}
@@ -1138,7 +1554,7 @@ static int SystemFile(const Value *args, Uint32 numArgs, Value *result)
 	memcpy(name, args[0].s->data, args[0].s->length);
 	name[args[0].s->length] = '\0';
 
-	result->succ.id = union_Alloc(environment.uni, sizeof(name));
+	result->succ.id = GCAlloc(sizeof(name), GC_DATA);
 	if (result->succ.id == NULL) {
 		return -1;
 	}
@@ -1146,13 +1562,14 @@ static int SystemFile(const Value *args, Uint32 numArgs, Value *result)
 
 	fp = fopen(name, "r");
 	if (fp == NULL) {
+		result->succ.content = NULL;
 		result->succ.success = false;
 		return 0;
 	}
 
 	fseek(fp, 0, SEEK_END);
 	pos = ftell(fp);
-	result->succ.content = union_Alloc(environment.uni, pos);
+	result->succ.content = GCAlloc(pos, GC_DATA);
 	if (result->succ.content == NULL) {
 		return -1;
 	}
@@ -1397,8 +1814,7 @@ static int SystemInsert(const Value *args, Uint32 numArgs, Value *result)
 			return -1;
 		}
 
-		newValues = union_Realloc(environment.uni, arr->values,
-				sizeof(*arr->values) *
+		newValues = GCRealloc(arr->values, sizeof(*arr->values) *
 				(arr->numValues + numArgs - 2));
 		if (newValues == NULL) {
 			return -1;
@@ -1409,6 +1825,9 @@ static int SystemInsert(const Value *args, Uint32 numArgs, Value *result)
 				(arr->numValues - index));
 		memcpy(&arr->values[index], &args[2],
 				sizeof(*arr->values) * (numArgs - 2));
+		for (Uint32 i = 2; i < numArgs; i++) {
+			GCBarrier(&args[i]);
+		}
 		arr->numValues += numArgs - 2;
 	} else if (args[0].type == TYPE_STRING) {
 		struct value_string *str;
@@ -1448,8 +1867,7 @@ static int SystemInsert(const Value *args, Uint32 numArgs, Value *result)
 			return 0;
 		}
 
-		newData = union_Realloc(environment.uni, str->data,
-				str->length + count);
+		newData = GCRealloc(str->data, str->length + count);
 		if (newData == NULL) {
 			return -1;
 		}
@@ -1478,6 +1896,8 @@ static int SystemInsert(const Value *args, Uint32 numArgs, Value *result)
 	} else {
 		return -1;
 	}
+	/* the value may be shown by any view */
+	view_InvalidateAll();
 	(void) result;
 	return 0;
 }
@@ -1590,13 +2010,13 @@ static int SystemName(const Value *args, Uint32 numArgs, Value *result)
 		return -1;
 	}
 
-	s = union_Allocf(environment.uni, sizeof(*s), 1 + TYPE_STRING);
+	s = GCAlloc(sizeof(*s), GC_TAG(TYPE_STRING));
 	if (s == NULL) {
 		return -1;
 	}
 
 	len = strlen(args[0].succ.id);
-	data = union_Alloc(environment.uni, len);
+	data = GCAlloc(len, GC_DATA);
 	if (data == NULL) {
 		return -1;
 	}
@@ -1783,6 +2203,123 @@ static void PrintValue(const Value *value, FILE *fp)
 	}
 }
 
+static void PrintStats(const char *name, const Union *uni, FILE *fp)
+{
+	UnionStats stats;
+
+	union_GetStats(uni, &stats);
+	fprintf(fp, "%s: live=%u allocated=%zu peak=%zu allocs=%" PRIu64
+			" reallocs=%" PRIu64 " frees=%" PRIu64 " scan=%.2f\n",
+			name, stats.numLive, stats.allocated,
+			stats.peakAllocated, stats.numAllocs,
+			stats.numReallocs, stats.numFrees,
+			stats.averageScan);
+}
+
+static void PrintViewStats(View *view, FILE *fp)
+{
+	for (; view != NULL; view = view->next) {
+		if (view->uni != NULL) {
+			PrintStats(view->label->name, view->uni, fp);
+		}
+		PrintViewStats(view->child, fp);
+	}
+}
+
+static int SystemDrawStats(const Value *args, Uint32 numArgs, Value *result)
+{
+	RendererStats stats;
+
+	(void) args;
+	if (numArgs != 0) {
+		return -1;
+	}
+	renderer_GetStats(&stats);
+	printf("draw: primitives=%" PRIu64 " batches=%" PRIu64
+			" flushes=%" PRIu64 " shape hits=%" PRIu64
+			" misses=%" PRIu64 " records=%" PRIu64
+			" replays=%" PRIu64 " word hits=%" PRIu64
+			" misses=%" PRIu64 " evictions=%" PRIu64
+			" words=%" PRIu64 " bytes=%" PRIu64 "\n",
+			stats.numPrimitives, stats.numBatches,
+			stats.numFlushes, stats.numShapeHits,
+			stats.numShapeMisses, stats.numRecords,
+			stats.numReplays, stats.numWordHits,
+			stats.numWordMisses, stats.numWordEvictions,
+			stats.numWords, stats.wordBytes);
+	(void) result;
+	return 0;
+}
+
+static int SystemFrameStats(const Value *args, Uint32 numArgs,
+		Value *result)
+{
+	FrameStats stats;
+	Value show;
+
+	if (numArgs > 1) {
+		return -1;
+	}
+	if (numArgs == 1) {
+		if (value_Cast(&args[0], TYPE_BOOL, &show) < 0) {
+			return -1;
+		}
+		gui_SetFrameOverlay(show.b);
+		(void) result;
+		return 0;
+	}
+	gui_GetFrameStats(&stats);
+	printf("frames: %u (microseconds p50/p95/p99/max)\n",
+			stats.numFrames);
+	for (Uint32 i = 0; i < FRAME_PHASE_MAX; i++) {
+		const PhaseStats *const p = &stats.phases[i];
+
+		printf("%s: %u/%u/%u/%u\n", gui_phaseNames[i],
+				p->p50, p->p95, p->p99, p->max);
+	}
+	printf("total: %u/%u/%u/%u\n", stats.total.p50, stats.total.p95,
+			stats.total.p99, stats.total.max);
+	(void) result;
+	return 0;
+}
+
+/* trace("file.json") starts writing a trace and trace() stops it */
+static int SystemTrace(const Value *args, Uint32 numArgs, Value *result)
+{
+	(void) result;
+	if (numArgs == 0) {
+		trace_Stop();
+		return 0;
+	}
+	if (numArgs != 1 || args[0].type != TYPE_STRING) {
+		return -1;
+	}
+
+	char name[args[0].s->length + 1];
+	memcpy(name, args[0].s->data, args[0].s->length);
+	name[args[0].s->length] = '\0';
+
+	return trace_Start(name);
+}
+
+static int SystemMemStats(const Value *args, Uint32 numArgs, Value *result)
+{
+	FILE *const fp = stdout;
+
+	(void) args;
+	if (numArgs != 0) {
+		return -1;
+	}
+	PrintStats("default", union_Default(), fp);
+	PrintStats("environment", environment.uni, fp);
+	PrintStats("frame", union_Frame(), fp);
+	PrintViewStats(view_Default(), fp);
+	fprintf(fp, "gc: cycles=%u collected=%" PRIu64 " threshold=%zu\n",
+			gc.cycle, gc.numCollected, gc.threshold);
+	(void) result;
+	return 0;
+}
+
 static int SystemPrint(const Value *args, Uint32 numArgs, Value *result)
 {
 	FILE *const fp = stdout;
@@ -1870,6 +2407,7 @@ static int SystemRemove(const Value *args, Uint32 numArgs, Value *result)
 	default:
 		return -1;
 	}
+	view_InvalidateAll();
 	(void) result;
 	return 0;
 }
@@ -1995,14 +2533,17 @@ static int SystemRgb(const Value *args, Uint32 numArgs, Value *result)
 
 static int SystemContains(const Value *args, Uint32 numArgs, Value *result)
 {
-	if (numArgs != 2) {
+	if (numArgs != 2 || args[1].type != TYPE_POINT) {
 		return -1;
 	}
-	if (args[0].type != TYPE_RECT || args[1].type != TYPE_POINT) {
+	result->type = TYPE_BOOL;
+	if (args[0].type == TYPE_RECT) {
+		result->b = rect_Contains(&args[0].r, &args[1].p);
+	} else if (args[0].type == TYPE_VIEW) {
+		result->b = view_ContainsPoint(args[0].v, &args[1].p);
+	} else {
 		return -1;
 	}
-	result->type = TYPE_BOOL;
-	result->b = rect_Contains(&args[0].r, &args[1].p);
 	return 0;
 }
 
@@ -2219,6 +2760,8 @@ static int SystemSetProperty(const Value *args, Uint32 numArgs, Value *result)
 		return -1;
 	}
 	*pValue = out;
+	GCBarrier(&out);
+	view_Invalidate(view);
 	(void) result;
 	return 0;
 }
@@ -2263,9 +2806,11 @@ static int SystemSetRect(const Value *args, Uint32 numArgs, Value *result)
 	if (numArgs == 0 || args[0].type != TYPE_VIEW) {
 		return -1;
 	}
+	view_Invalidate(args[0].v);
 	if (args_GetRect(&args[1], numArgs - 1, &args[0].v->rect) < 0) {
 		return -1;
 	}
+	view_Invalidate(args[0].v);
 	(void) result;
 	return 0;
 }
@@ -2301,13 +2846,13 @@ static int SystemGetText(const Value *args, Uint32 numArgs, Value *result)
 	if (numArgs != 1 || args[0].type != TYPE_EVENT) {
 		return -1;
 	}
-	str = union_Alloc(union_Default(), sizeof(*str));
+	str = GCAlloc(sizeof(*str), GC_TAG(TYPE_STRING));
 	if (str == NULL) {
 		return -1;
 	}
 
 	len = strlen(args[0].e.info.ti.text);
-	data = union_Alloc(union_Default(), len + 1);
+	data = GCAlloc(len + 1, GC_DATA);
 	if (data == NULL) {
 		return -1;
 	}
@@ -2389,6 +2934,31 @@ static int SystemGetWheel(const Value *args, Uint32 numArgs, Value *result)
 	return 0;
 }
 
+static int SystemSetTimer(const Value *args, Uint32 numArgs, Value *result)
+{
+	Value ms;
+
+	if (numArgs != 2 || args[0].type != TYPE_VIEW) {
+		return -1;
+	}
+	if (value_Cast(&args[1], TYPE_INTEGER, &ms) < 0 || ms.i < 0) {
+		return -1;
+	}
+	view_SetTimer(args[0].v, ms.i);
+	(void) result;
+	return 0;
+}
+
+static int SystemKillTimer(const Value *args, Uint32 numArgs, Value *result)
+{
+	if (numArgs != 1 || args[0].type != TYPE_VIEW) {
+		return -1;
+	}
+	view_KillTimer(args[0].v);
+	(void) result;
+	return 0;
+}
+
 static int SystemSetTextInputRect(const Value *args, Uint32 numArgs,
 		Value *result)
 {
@@ -2452,11 +3022,13 @@ static int ExecuteSystem(const char *call,
 	} functions[] = {
 		{ "and", SystemAnd },
 		{ "div", SystemDiv },
+		{ "drawstats", SystemDrawStats },
 		{ "dup", SystemDup },
 		{ "equals", SystemEquals },
 		{ "exists", SystemExists },
 		{ "file", SystemFile },
 		{ "float", SystemFloat },
+		{ "framestats", SystemFrameStats },
 		{ "get", SystemGet },
 		{ "geq", SystemGeq },
 		{ "gtr", SystemGtr },
@@ -2467,6 +3039,7 @@ static int ExecuteSystem(const char *call,
 		{ "length", SystemLength },
 		{ "leq", SystemLeq },
 		{ "lss", SystemLss },
+		{ "memstats", SystemMemStats },
 		{ "mod", SystemMod },
 		{ "mul", SystemMul },
 		{ "name", SystemName },
@@ -2481,6 +3054,7 @@ static int ExecuteSystem(const char *call,
 		{ "rgb", SystemRgb },
 		{ "sub", SystemSub },
 		{ "sum", SystemSum },
+		{ "trace", SystemTrace },
 
 		{ "Contains", SystemContains },
 		{ "CreateFont", SystemCreateFont },
@@ -2504,18 +3078,22 @@ static int ExecuteSystem(const char *call,
 		{ "GetWheel", SystemGetWheel },
 		{ "GetWindowHeight", SystemGetWindowHeight },
 		{ "GetWindowWidth", SystemGetWindowWidth },
+		{ "KillTimer", SystemKillTimer },
 		{ "SetDrawColor", SystemSetDrawColor },
 		{ "SetFont", SystemSetFont },
 		{ "SetParent", SystemSetParent },
 		{ "SetProperty", SystemSetProperty },
 		{ "SetRect", SystemSetRect },
 		{ "SetTextInputRect", SystemSetTextInputRect },
+		{ "SetTimer", SystemSetTimer },
 
 		{ "Utf8Next", SystemUtf8Next },
 		{ "Utf8Prev", SystemUtf8Prev },
 	};
 
 	const struct system_function *sys = NULL;
+	Value *values;
+	int r;
 
 	for (Uint32 i = 0; i < (Uint32) ARRLEN(functions); i++) {
 		if (strcmp(functions[i].name, call) == 0) {
@@ -2527,13 +3105,15 @@ static int ExecuteSystem(const char *call,
 		return -1;
 	}
 
-	Value values[numArgs];
-	for (Uint32 i = 0; i < numArgs; i++) {
-		if (EvaluateInstruction(&args[i], &values[i]) < 0) {
-			return -1;
-		}
+	values = EvaluateArguments(args, numArgs);
+	if (values == NULL && numArgs > 0) {
+		return -1;
+	}
+	r = sys->call(values, numArgs, result);
+	if (values != NULL) {
+		union_Free(union_Frame(), values);
 	}
-	return sys->call(values, numArgs, result);
+	return r;
 }
 
 static int MergeWithLabel(const RawWrapper *wrapper)
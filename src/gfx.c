@@ -239,35 +239,421 @@ void HslToRgb(const hsl_t *hsl, rgb_t *rgb)
 	rgb->blue = (b + m) * 255.0f;
 }
 
+/* primitives of one draw color are queued and drawn with one call per
+ * kind when the color changes or someone else uses the renderer;
+ * axis aligned lines become one pixel wide rects */
+static struct batch {
+	SDL_Rect *rects;
+	Uint32 numRects;
+	Uint32 capRects;
+	SDL_Point *points;
+	Uint32 numPoints;
+	Uint32 capPoints;
+	/* connected lines, a line that does not start at the end of the
+	 * previous one starts a new call */
+	SDL_Point *lines;
+	Uint32 numLines;
+	Uint32 capLines;
+	Uint32 color;
+	bool knownColor;
+	/* added to all coordinates, for drawing into textures */
+	Sint32 dx, dy;
+	RendererStats stats;
+} batch;
+
+static void *Grow(void *data, Uint32 *cap, Uint32 need, Size size)
+{
+	Uint32 newCap;
+
+	if (need <= *cap) {
+		return data;
+	}
+	newCap = MAX(need, *cap * 2 + 64);
+	data = union_Realloc(union_Default(), data, size * newCap);
+	if (data != NULL) {
+		*cap = newCap;
+	}
+	return data;
+}
+
+static int FlushLines(void)
+{
+	int result = 0;
+
+	if (batch.numLines > 1) {
+		result = SDL_RenderDrawLines(renderer_Default(), batch.lines,
+				batch.numLines);
+		batch.stats.numBatches++;
+	}
+	batch.numLines = 0;
+	return result;
+}
+
+int renderer_Flush(void)
+{
+	int result = 0;
+
+	if (batch.numRects > 0) {
+		result |= SDL_RenderFillRects(renderer_Default(), batch.rects,
+				batch.numRects);
+		batch.stats.numBatches++;
+		batch.numRects = 0;
+	}
+	result |= FlushLines();
+	if (batch.numPoints > 0) {
+		result |= SDL_RenderDrawPoints(renderer_Default(),
+				batch.points, batch.numPoints);
+		batch.stats.numBatches++;
+		batch.numPoints = 0;
+	}
+	batch.stats.numFlushes++;
+	/* whoever flushes may change the color behind our back */
+	batch.knownColor = false;
+	return result;
+}
+
+void renderer_SetOffset(Sint32 dx, Sint32 dy)
+{
+	if (dx != batch.dx || dy != batch.dy) {
+		renderer_Flush();
+		batch.dx = dx;
+		batch.dy = dy;
+	}
+}
+
+void renderer_GetOffset(Sint32 *dx, Sint32 *dy)
+{
+	*dx = batch.dx;
+	*dy = batch.dy;
+}
+
+int renderer_DrawTexture(Texture *texture, const Rect *rect)
+{
+	const Rect r = {
+		rect->x + batch.dx, rect->y + batch.dy, rect->w, rect->h
+	};
+
+	renderer_Flush();
+	return SDL_RenderCopy(renderer_Default(), texture, NULL, &r);
+}
+
+enum {
+	CMD_COLOR,
+	CMD_FONT,
+	CMD_DRAW_RECT,
+	CMD_FILL_RECT,
+	CMD_LINE,
+	CMD_DRAW_ELLIPSE,
+	CMD_FILL_ELLIPSE,
+	CMD_TEXT,
+};
+
+struct draw_command {
+	Uint32 type;
+	union {
+		Uint32 color;
+		Uint32 font;
+		/* rects, ellipses and lines as x1, y1, x2, y2 */
+		Rect rect;
+		struct {
+			Sint32 x, y;
+			Uint32 offset, length;
+		} text;
+	};
+};
+
+static DisplayList *recording;
+
+/* returns NULL when nothing is recording, a failed allocation leaves
+ * the list dirty so that it is not replayed */
+static struct draw_command *Record(Uint32 type)
+{
+	struct draw_command *commands;
+
+	if (recording == NULL) {
+		return NULL;
+	}
+	commands = Grow(recording->commands, &recording->capCommands,
+			recording->numCommands + 1, sizeof(*commands));
+	if (commands == NULL) {
+		recording->dirty = true;
+		return NULL;
+	}
+	recording->commands = commands;
+	commands[recording->numCommands].type = type;
+	return &commands[recording->numCommands++];
+}
+
+static void RecordRect(Uint32 type, Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+{
+	struct draw_command *const cmd = Record(type);
+
+	if (cmd != NULL) {
+		cmd->rect = (Rect) { x, y, w, h };
+	}
+}
+
+static void RecordText(const char *text, Uint32 length, Sint32 x, Sint32 y)
+{
+	struct draw_command *cmd;
+	char *newText;
+
+	cmd = Record(CMD_TEXT);
+	if (cmd == NULL) {
+		return;
+	}
+	newText = Grow(recording->text, &recording->capText,
+			recording->lenText + length, 1);
+	if (newText == NULL) {
+		recording->numCommands--;
+		recording->dirty = true;
+		return;
+	}
+	recording->text = newText;
+	memcpy(&newText[recording->lenText], text, length);
+	cmd->text.x = x;
+	cmd->text.y = y;
+	cmd->text.offset = recording->lenText;
+	cmd->text.length = length;
+	recording->lenText += length;
+}
+
+void renderer_BeginRecord(DisplayList *list)
+{
+	list->numCommands = 0;
+	list->lenText = 0;
+	list->valid = false;
+	list->dirty = false;
+	recording = list;
+	batch.stats.numRecords++;
+}
+
+void renderer_EndRecord(void)
+{
+	recording->valid = !recording->dirty;
+	recording = NULL;
+}
+
+int renderer_Replay(const DisplayList *list)
+{
+	int result = 0;
+	Rect r;
+
+	batch.stats.numReplays++;
+	for (Uint32 i = 0; i < list->numCommands; i++) {
+		const struct draw_command *const cmd = &list->commands[i];
+
+		r = cmd->rect;
+		switch (cmd->type) {
+		case CMD_COLOR:
+			result |= renderer_SetDrawColorRGB(cmd->color >> 24,
+					(cmd->color >> 16) & 0xff,
+					(cmd->color >> 8) & 0xff,
+					cmd->color & 0xff);
+			break;
+		case CMD_FONT:
+			result |= renderer_SelectFont(cmd->font);
+			break;
+		case CMD_DRAW_RECT:
+			result |= renderer_DrawRect(&r);
+			break;
+		case CMD_FILL_RECT:
+			result |= renderer_FillRect(&r);
+			break;
+		case CMD_LINE:
+			result |= renderer_DrawLine(r.x, r.y, r.w, r.h);
+			break;
+		case CMD_DRAW_ELLIPSE:
+			result |= renderer_DrawEllipse(r.x, r.y, r.w, r.h);
+			break;
+		case CMD_FILL_ELLIPSE:
+			result |= renderer_FillEllipse(r.x, r.y, r.w, r.h);
+			break;
+		case CMD_TEXT:
+			r.x = cmd->text.x;
+			r.y = cmd->text.y;
+			result |= renderer_DrawText(&list->text[cmd->text.offset],
+					cmd->text.length, &r);
+			break;
+		}
+	}
+	return result;
+}
+
+void renderer_DropList(DisplayList *list)
+{
+	list->valid = false;
+	list->dirty = true;
+}
+
+void renderer_FreeList(DisplayList *list)
+{
+	if (list->commands != NULL) {
+		union_Free(union_Default(), list->commands);
+	}
+	if (list->text != NULL) {
+		union_Free(union_Default(), list->text);
+	}
+	memset(list, 0, sizeof(*list));
+}
+
+static int SetColor(Uint8 a, Uint8 r, Uint8 g, Uint8 b)
+{
+	const Uint32 color = ((Uint32) a << 24) | (r << 16) | (g << 8) | b;
+	struct draw_command *const cmd = Record(CMD_COLOR);
+
+	if (cmd != NULL) {
+		cmd->color = color;
+	}
+
+	if (!batch.knownColor || color != batch.color) {
+		if (batch.numRects > 0 || batch.numLines > 0 ||
+				batch.numPoints > 0) {
+			renderer_Flush();
+		}
+		batch.color = color;
+		batch.knownColor = true;
+	}
+	return SDL_SetRenderDrawColor(renderer_Default(), r, g, b, a);
+}
+
 int renderer_SetDrawColor(Uint32 color)
 {
-	return SDL_SetRenderDrawColor(renderer_Default(), (color >> 16) & 0xff,
-			(color >> 8) & 0xff, color & 0xff, 255);
+	return SetColor(255, (color >> 16) & 0xff, (color >> 8) & 0xff,
+			color & 0xff);
 }
 
 int renderer_SetDrawColorRGB(Uint8 a,
 		Uint8 r, Uint8 g, Uint8 b)
 {
-	return SDL_SetRenderDrawColor(renderer_Default(), r, g, b, a);
+	return SetColor(a, r, g, b);
+}
+
+static int BatchRect(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+{
+	SDL_Rect *rects;
+
+	rects = Grow(batch.rects, &batch.capRects, batch.numRects + 1,
+			sizeof(*rects));
+	if (rects == NULL) {
+		return -1;
+	}
+	batch.rects = rects;
+	rects[batch.numRects++] = (SDL_Rect) { x, y, w, h };
+	batch.stats.numPrimitives++;
+	return 0;
 }
 
 int renderer_DrawRect(Rect *rect)
 {
-	return SDL_RenderDrawRect(renderer_Default(), rect);
+	const Sint32 x = rect->x + batch.dx, y = rect->y + batch.dy;
+	const Sint32 w = rect->w, h = rect->h;
+
+	RecordRect(CMD_DRAW_RECT, rect->x, rect->y, w, h);
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+	if (w <= 2 || h <= 2) {
+		return BatchRect(x, y, w, h);
+	}
+	/* the same pixels SDL_RenderDrawRect() sets */
+	return BatchRect(x, y, w, 1) | BatchRect(x, y + h - 1, w, 1) |
+		BatchRect(x, y + 1, 1, h - 2) |
+		BatchRect(x + w - 1, y + 1, 1, h - 2);
 }
 
 int renderer_FillRect(Rect *rect)
 {
-	return SDL_RenderFillRect(renderer_Default(), rect);
+	RecordRect(CMD_FILL_RECT, rect->x, rect->y, rect->w, rect->h);
+	if (rect->w <= 0 || rect->h <= 0) {
+		return 0;
+	}
+	return BatchRect(rect->x + batch.dx, rect->y + batch.dy,
+			rect->w, rect->h);
+}
+
+static int BatchLine(Sint32 x1, Sint32 y1, Sint32 x2, Sint32 y2)
+{
+	SDL_Point *lines;
+
+	if (x1 == x2) {
+		return BatchRect(x1, MIN(y1, y2), 1, abs(y2 - y1) + 1);
+	}
+	if (y1 == y2) {
+		return BatchRect(MIN(x1, x2), y1, abs(x2 - x1) + 1, 1);
+	}
+	if (batch.numLines > 0 && (batch.lines[batch.numLines - 1].x != x1 ||
+				batch.lines[batch.numLines - 1].y != y1)) {
+		FlushLines();
+	}
+	lines = Grow(batch.lines, &batch.capLines, batch.numLines + 2,
+			sizeof(*lines));
+	if (lines == NULL) {
+		return -1;
+	}
+	batch.lines = lines;
+	if (batch.numLines == 0) {
+		lines[batch.numLines++] = (SDL_Point) { x1, y1 };
+	}
+	lines[batch.numLines++] = (SDL_Point) { x2, y2 };
+	batch.stats.numPrimitives++;
+	return 0;
 }
 
 int renderer_DrawLine(Sint32 x1, Sint32 y1, Sint32 x2, Sint32 y2)
 {
-	return SDL_RenderDrawLine(renderer_Default(), x1, y1, x2, y2);
+	RecordRect(CMD_LINE, x1, y1, x2, y2);
+	return BatchLine(x1 + batch.dx, y1 + batch.dy,
+			x2 + batch.dx, y2 + batch.dy);
 }
 
-int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+/* outlines and fills of ellipses are traced once around the origin
+ * and then only translated, keyed by the radii */
+#define SHAPE_CACHE 64
+
+struct shape {
+	Sint32 w, h;
+	bool fill;
+	/* points of an outline or rows of a fill */
+	SDL_Point *points;
+	SDL_Rect *rects;
+	Uint32 num;
+	Uint32 cap;
+};
+
+static struct shape shape_cache[SHAPE_CACHE];
+
+static int ShapePoint(struct shape *shape, Sint32 x, Sint32 y)
 {
+	SDL_Point *points;
+
+	points = Grow(shape->points, &shape->cap, shape->num + 1,
+			sizeof(*points));
+	if (points == NULL) {
+		return -1;
+	}
+	shape->points = points;
+	points[shape->num++] = (SDL_Point) { x, y };
+	return 0;
+}
+
+static int ShapeSpan(struct shape *shape, Sint32 x1, Sint32 x2, Sint32 y)
+{
+	SDL_Rect *rects;
+
+	rects = Grow(shape->rects, &shape->cap, shape->num + 1,
+			sizeof(*rects));
+	if (rects == NULL) {
+		return -1;
+	}
+	shape->rects = rects;
+	rects[shape->num++] = (SDL_Rect) { x1, y, x2 - x1 + 1, 1 };
+	return 0;
+}
+
+static int TraceOutline(struct shape *shape, Sint32 w, Sint32 h)
+{
+	const Sint32 x = 0, y = 0;
 	int result;
 	Sint32 ix, iy;
 	Sint32 l, i, j, k;
@@ -277,16 +663,6 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 	Sint32 xmj, xpj, ymi, ypi;
 	Sint32 xmk, xpk, yml, ypl;
 
-	if (w < 0 || h < 0) {
-		return -1;
-	}
-	if (w == 0) {
-		return SDL_RenderDrawLine(renderer_Default(), x, y, x, y + h);
-	}
-	if (h == 0) {
-		return SDL_RenderDrawLine(renderer_Default(), x, y, x + w, y);
-	}
-
 	result = 0;
 	ol = oi = oj = ok = INT32_MAX;
 
@@ -307,13 +683,13 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				if (k > 0) {
 					ypk = y + k;
 					ymk = y - k;
-					result |= SDL_RenderDrawPoint(renderer_Default(), xml, ypk);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpl, ypk);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xml, ymk);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpl, ymk);
+					result |= ShapePoint(shape, xml, ypk);
+					result |= ShapePoint(shape, xpl, ypk);
+					result |= ShapePoint(shape, xml, ymk);
+					result |= ShapePoint(shape, xpl, ymk);
 				} else {
-					result |= SDL_RenderDrawPoint(renderer_Default(), xml, y);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpl, y);
+					result |= ShapePoint(shape, xml, y);
+					result |= ShapePoint(shape, xpl, y);
 				}
 				ok = k;
 				xpi = x + i;
@@ -321,13 +697,13 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				if (j > 0) {
 					ypj = y + j;
 					ymj = y - j;
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmi, ypj);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpi, ypj);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmi, ymj);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpi, ymj);
+					result |= ShapePoint(shape, xmi, ypj);
+					result |= ShapePoint(shape, xpi, ypj);
+					result |= ShapePoint(shape, xmi, ymj);
+					result |= ShapePoint(shape, xpi, ymj);
 				} else {
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmi, y);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpi, y);
+					result |= ShapePoint(shape, xmi, y);
+					result |= ShapePoint(shape, xpi, y);
 				}
 				oj = j;
 			}
@@ -352,13 +728,13 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				if (i > 0) {
 					ypi = y + i;
 					ymi = y - i;
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmj, ypi);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpj, ypi);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmj, ymi);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpj, ymi);
+					result |= ShapePoint(shape, xmj, ypi);
+					result |= ShapePoint(shape, xpj, ypi);
+					result |= ShapePoint(shape, xmj, ymi);
+					result |= ShapePoint(shape, xpj, ymi);
 				} else {
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmj, y);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpj, y);
+					result |= ShapePoint(shape, xmj, y);
+					result |= ShapePoint(shape, xpj, y);
 				}
 				oi = i;
 				xmk = x - k;
@@ -366,13 +742,13 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				if (h > 0) {
 					ypl = y + l;
 					yml = y - l;
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmk, ypl);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpk, ypl);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmk, yml);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpk, yml);
+					result |= ShapePoint(shape, xmk, ypl);
+					result |= ShapePoint(shape, xpk, ypl);
+					result |= ShapePoint(shape, xmk, yml);
+					result |= ShapePoint(shape, xpk, yml);
 				} else {
-					result |= SDL_RenderDrawPoint(renderer_Default(), xmk, y);
-					result |= SDL_RenderDrawPoint(renderer_Default(), xpk, y);
+					result |= ShapePoint(shape, xmk, y);
+					result |= ShapePoint(shape, xpk, y);
 				}
 				ol = l;
 			}
@@ -385,8 +761,9 @@ int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 	return result;
 }
 
-int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+static int TraceFill(struct shape *shape, Sint32 w, Sint32 h)
 {
+	const Sint32 x = 0, y = 0;
 	int result;
 	Sint32 ix, iy;
 	Sint32 l, i, j, k;
@@ -396,16 +773,6 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 	Sint32 xmj, xpj;
 	Sint32 xmk, xpk;
 
-	if (w < 0 || h < 0) {
-		return -1;
-	}
-	if (w == 0) {
-		return SDL_RenderDrawLine(renderer_Default(), x, y, x, y + h);
-	}
-	if (h == 0) {
-		return SDL_RenderDrawLine(renderer_Default(), x, y, x + w, y);
-	}
-
 	result = 0;
 
 	ol = oi = oj = ok = 0xFFFF;
@@ -425,10 +792,10 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				xpl = x + l;
 				xml = x - l;
 				if (k > 0) {
-					result |= SDL_RenderDrawLine(renderer_Default(), xml, y + k, xpl, y + k);
-					result |= SDL_RenderDrawLine(renderer_Default(), xml, y - k, xpl, y - k);
+					result |= ShapeSpan(shape, xml, xpl, y + k);
+					result |= ShapeSpan(shape, xml, xpl, y - k);
 				} else {
-					result |= SDL_RenderDrawLine(renderer_Default(), xml, y, xpl, y);
+					result |= ShapeSpan(shape, xml, xpl, y);
 				}
 				ok = k;
 			}
@@ -436,10 +803,10 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				xmi = x - i;
 				xpi = x + i;
 				if (j > 0) {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmi, y + j, xpi, y + j);
-					result |= SDL_RenderDrawLine(renderer_Default(), xmi, y - j, xpi, y - j);
+					result |= ShapeSpan(shape, xmi, xpi, y + j);
+					result |= ShapeSpan(shape, xmi, xpi, y - j);
 				} else {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmi, y, xpi, y);
+					result |= ShapeSpan(shape, xmi, xpi, y);
 				}
 				oj = j;
 			}
@@ -462,10 +829,10 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				xmj = x - j;
 				xpj = x + j;
 				if (i > 0) {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmj, y + i, xpj, y + i);
-					result |= SDL_RenderDrawLine(renderer_Default(), xmj, y - i, xpj, y - i);
+					result |= ShapeSpan(shape, xmj, xpj, y + i);
+					result |= ShapeSpan(shape, xmj, xpj, y - i);
 				} else {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmj, y, xpj, y);
+					result |= ShapeSpan(shape, xmj, xpj, y);
 				}
 				oi = i;
 			}
@@ -473,10 +840,10 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 				xmk = x - k;
 				xpk = x + k;
 				if (l > 0) {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmk, y + l, xpk, y + l);
-					result |= SDL_RenderDrawLine(renderer_Default(), xmk, y - l, xpk, y - l);
+					result |= ShapeSpan(shape, xmk, xpk, y + l);
+					result |= ShapeSpan(shape, xmk, xpk, y - l);
 				} else {
-					result |= SDL_RenderDrawLine(renderer_Default(), xmk, y, xpk, y);
+					result |= ShapeSpan(shape, xmk, xpk, y);
 				}
 				ol = l;
 			}
@@ -490,12 +857,164 @@ int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
 	return result;
 }
 
+static int CompareRows(const void *a, const void *b)
+{
+	const SDL_Rect *const r1 = a, *const r2 = b;
+
+	if (r1->x != r2->x) {
+		return r1->x < r2->x ? -1 : 1;
+	}
+	if (r1->w != r2->w) {
+		return r1->w < r2->w ? -1 : 1;
+	}
+	return r1->y < r2->y ? -1 : r1->y > r2->y;
+}
+
+/* rows of the same span are drawn once and stacked into taller rects */
+static void MergeRows(struct shape *shape)
+{
+	Uint32 n;
+
+	if (shape->num == 0) {
+		return;
+	}
+	qsort(shape->rects, shape->num, sizeof(*shape->rects), CompareRows);
+	n = 0;
+	for (Uint32 i = 1; i < shape->num; i++) {
+		SDL_Rect *const last = &shape->rects[n];
+		const SDL_Rect *const r = &shape->rects[i];
+
+		if (r->x == last->x && r->w == last->w &&
+				r->y <= last->y + last->h) {
+			last->h = MAX(last->h, r->y + r->h - last->y);
+		} else {
+			shape->rects[++n] = *r;
+		}
+	}
+	shape->num = n + 1;
+}
+
+static struct shape *GetShape(Sint32 w, Sint32 h, bool fill)
+{
+	struct shape *shape;
+	Uint32 hash;
+
+	hash = ((Uint32) w * 0x9e3779b1u) ^ ((Uint32) h * 0x85ebca77u) ^ fill;
+	shape = &shape_cache[(hash ^ (hash >> 16)) % SHAPE_CACHE];
+	if (shape->num > 0 && shape->w == w && shape->h == h &&
+			shape->fill == fill) {
+		batch.stats.numShapeHits++;
+		return shape;
+	}
+	batch.stats.numShapeMisses++;
+
+	if (shape->points != NULL) {
+		union_Free(union_Default(), shape->points);
+	}
+	if (shape->rects != NULL) {
+		union_Free(union_Default(), shape->rects);
+	}
+	shape->points = NULL;
+	shape->rects = NULL;
+	shape->num = 0;
+	shape->cap = 0;
+	shape->w = w;
+	shape->h = h;
+	shape->fill = fill;
+	if ((fill ? TraceFill(shape, w, h) : TraceOutline(shape, w, h)) != 0) {
+		shape->num = 0;
+		return NULL;
+	}
+	if (fill) {
+		MergeRows(shape);
+	}
+	return shape;
+}
+
+int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+{
+	struct shape *shape;
+	SDL_Point *points;
+
+	if (w < 0 || h < 0) {
+		return -1;
+	}
+	RecordRect(CMD_DRAW_ELLIPSE, x, y, w, h);
+	x += batch.dx;
+	y += batch.dy;
+	if (w == 0) {
+		return BatchLine(x, y, x, y + h);
+	}
+	if (h == 0) {
+		return BatchLine(x, y, x + w, y);
+	}
+
+	shape = GetShape(w, h, false);
+	if (shape == NULL) {
+		return -1;
+	}
+	points = Grow(batch.points, &batch.capPoints,
+			batch.numPoints + shape->num, sizeof(*points));
+	if (points == NULL) {
+		return -1;
+	}
+	batch.points = points;
+	for (Uint32 i = 0; i < shape->num; i++) {
+		points[batch.numPoints++] = (SDL_Point) {
+			x + shape->points[i].x, y + shape->points[i].y
+		};
+	}
+	batch.stats.numPrimitives++;
+	return 0;
+}
+
+int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 w, Sint32 h)
+{
+	struct shape *shape;
+	SDL_Rect *rects;
+
+	if (w < 0 || h < 0) {
+		return -1;
+	}
+	RecordRect(CMD_FILL_ELLIPSE, x, y, w, h);
+	x += batch.dx;
+	y += batch.dy;
+	if (w == 0) {
+		return BatchLine(x, y, x, y + h);
+	}
+	if (h == 0) {
+		return BatchLine(x, y, x + w, y);
+	}
+
+	shape = GetShape(w, h, true);
+	if (shape == NULL) {
+		return -1;
+	}
+	rects = Grow(batch.rects, &batch.capRects,
+			batch.numRects + shape->num, sizeof(*rects));
+	if (rects == NULL) {
+		return -1;
+	}
+	batch.rects = rects;
+	for (Uint32 i = 0; i < shape->num; i++) {
+		rects[batch.numRects++] = (SDL_Rect) {
+			x + shape->rects[i].x, y + shape->rects[i].y,
+			shape->rects[i].w, shape->rects[i].h
+		};
+	}
+	batch.stats.numPrimitives++;
+	return 0;
+}
+
 struct font *cached_fonts;
 
 Uint32 num_fonts;
 Uint32 cur_font;
 
 float tab_multiplier = 4.0f;
+static Uint32 text_backend = TEXT_BACKEND_WORDS;
+static Size word_max_bytes = 64 << 20;
+static Uint32 word_max_words = 8192;
 
 static Uint32 AddFont(Font *font)
 {
@@ -523,14 +1042,22 @@ static Uint32 AddFont(Font *font)
 			return UINT32_MAX;
 		}
 		cached_fonts = newFonts;
+		memset(&cached_fonts[num_fonts], 0, sizeof(*cached_fonts));
 		cached_fonts[num_fonts].font = font;
-		cached_fonts[num_fonts].cachedWords = NULL;
-		cached_fonts[num_fonts].numCachedWords = 0;
 		num_fonts++;
 	}
 	return iFont;
 }
 
+static void RecordFont(void)
+{
+	struct draw_command *const cmd = Record(CMD_FONT);
+
+	if (cmd != NULL) {
+		cmd->font = cur_font;
+	}
+}
+
 int renderer_SetFont(Font *font)
 {
 	Uint32 iFont;
@@ -540,6 +1067,7 @@ int renderer_SetFont(Font *font)
 		return -1;
 	}
 	cur_font = iFont;
+	RecordFont();
 	return 0;
 }
 
@@ -549,6 +1077,7 @@ int renderer_SelectFont(Uint32 index)
 		return -1;
 	}
 	cur_font = index;
+	RecordFont();
 	return 0;
 }
 
@@ -557,6 +1086,17 @@ void renderer_SetTabMultiplier(float multp)
 	tab_multiplier = multp;
 }
 
+void renderer_SetTextBackend(Uint32 backend)
+{
+	text_backend = backend;
+}
+
+void renderer_SetWordCacheLimits(Size maxBytes, Uint32 maxWords)
+{
+	word_max_bytes = maxBytes;
+	word_max_words = maxWords;
+}
+
 Font *renderer_CreateFont(const char *name, int size, Uint32 *pIndex)
 {
 	Font *font;
@@ -585,74 +1125,580 @@ Font *renderer_GetFont(Uint32 index)
 	return cached_fonts[index].font;
 }
 
-static struct word *GetCachedWord(const char *data)
+void renderer_GetStats(RendererStats *stats)
 {
-	struct font font;
+	*stats = batch.stats;
+	stats->numWords = 0;
+	stats->wordBytes = 0;
+	for (Uint32 i = 0; i < num_fonts; i++) {
+		stats->numWords += cached_fonts[i].numCachedWords;
+		stats->wordBytes += cached_fonts[i].wordBytes;
+	}
+}
+
+#define MIN_WORD_INDEX 64
+
+/* fnv-1a */
+static Uint32 HashWord(const char *text, Uint32 length)
+{
+	Uint32 h = 2166136261u;
+
+	for (Uint32 i = 0; i < length; i++) {
+		h ^= (Uint8) text[i];
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	font = cached_fonts[cur_font];
-	for (Uint32 i = 0; i < font.numCachedWords; i++) {
-		struct word *const word = &font.cachedWords[i];
-		if (strcmp(word->data, data) == 0) {
+static struct word *GetCachedWord(struct font *font,
+		const char *text, Uint32 length, Uint32 hash)
+{
+	Uint32 mask, slot, entry;
+
+	if (font->capWordIndex == 0) {
+		return NULL;
+	}
+	mask = font->capWordIndex - 1;
+	slot = hash & mask;
+	/* the index is never full, so this terminates */
+	while ((entry = font->wordIndex[slot]) != 0) {
+		struct word *const word = &font->cachedWords[entry - 1];
+
+		if (word->hash == hash && word->length == length &&
+				memcmp(word->data, text, length) == 0) {
+			word->referenced = true;
 			return word;
 		}
+		slot = (slot + 1) & mask;
 	}
 	return NULL;
 }
 
-static struct word *CacheWord(const char *data)
+static void InsertWord(struct font *font, Uint32 index)
 {
-	const Color white = { 255, 255, 255, 255 };
-	const Color black = { 0, 0, 0, 0 };
+	Uint32 mask, slot;
 
-	struct font *font;
+	mask = font->capWordIndex - 1;
+	slot = font->cachedWords[index].hash & mask;
+	while (font->wordIndex[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	font->wordIndex[slot] = index + 1;
+}
 
-	struct word *newWords;
+/* the slot in the index that points to word index */
+static Uint32 FindWordSlot(struct font *font, Uint32 index)
+{
+	Uint32 mask, slot;
 
-	SDL_Surface *textSurface;
+	mask = font->capWordIndex - 1;
+	slot = font->cachedWords[index].hash & mask;
+	while (font->wordIndex[slot] != index + 1) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
 
-	struct word word;
+/* empties a slot and moves later entries of the same probe sequence
+ * back into it, so that lookups never need tombstones */
+static void RemoveWordSlot(struct font *font, Uint32 slot)
+{
+	const Uint32 mask = font->capWordIndex - 1;
+	Uint32 next, entry, home;
+
+	for (next = (slot + 1) & mask; (entry = font->wordIndex[next]) != 0;
+			next = (next + 1) & mask) {
+		home = font->cachedWords[entry - 1].hash & mask;
+		/* an entry whose home lies cyclically in (slot, next] has to
+		 * stay after its home */
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			font->wordIndex[slot] = entry;
+			slot = next;
+		}
+	}
+	font->wordIndex[slot] = 0;
+}
 
-	Size len;
+static Size GetWordBytes(const struct word *word)
+{
+	return (Size) word->width * word->height * 4 + word->length + 1;
+}
 
-	font = &cached_fonts[cur_font];
+/* removes a word by moving the last word into its place */
+static void EvictWord(struct font *font, Uint32 index)
+{
+	struct word *const word = &font->cachedWords[index];
+	const Uint32 last = font->numCachedWords - 1;
+
+	RemoveWordSlot(font, FindWordSlot(font, index));
+	font->wordBytes -= GetWordBytes(word);
+	SDL_DestroyTexture(word->texture);
+	union_Free(union_Default(), word->data);
+	if (index != last) {
+		font->wordIndex[FindWordSlot(font, last)] = index + 1;
+		*word = font->cachedWords[last];
+	}
+	font->numCachedWords--;
+	batch.stats.numWordEvictions++;
+}
 
-	newWords = union_Realloc(union_Default(), font->cachedWords,
-			sizeof(*font->cachedWords) *
-			(font->numCachedWords + 1));
-	if (newWords == NULL) {
-		return NULL;
+/* evicts with the clock algorithm until a word of size bytes fits */
+static void EvictWords(struct font *font, Size bytes)
+{
+	struct word *word;
+
+	while (font->numCachedWords > 0 &&
+			(font->numCachedWords >= word_max_words ||
+			 font->wordBytes + bytes > word_max_bytes)) {
+		if (font->clockHand >= font->numCachedWords) {
+			font->clockHand = 0;
+		}
+		word = &font->cachedWords[font->clockHand];
+		if (word->referenced) {
+			word->referenced = false;
+			font->clockHand++;
+		} else {
+			/* the last word moved here is looked at next */
+			EvictWord(font, font->clockHand);
+		}
+	}
+}
+
+/* makes room for one more word in the array and the index */
+static int ReserveWord(struct font *font)
+{
+	struct word *newWords;
+	Uint32 *newIndex;
+	Uint32 cap;
+
+	if (font->numCachedWords == font->capCachedWords) {
+		cap = font->capCachedWords * 2 + 16;
+		newWords = union_Realloc(union_Default(), font->cachedWords,
+				sizeof(*newWords) * cap);
+		if (newWords == NULL) {
+			return -1;
+		}
+		font->cachedWords = newWords;
+		font->capCachedWords = cap;
 	}
-	font->cachedWords = newWords;
 
-	textSurface = TTF_RenderUTF8_LCD(font->font, data, white, black);
+	/* keep the load at three quarters at most */
+	if ((font->numCachedWords + 1) * 4 <= font->capWordIndex * 3) {
+		return 0;
+	}
+	for (cap = MIN_WORD_INDEX; cap < (font->numCachedWords + 1) * 2; ) {
+		cap *= 2;
+	}
+	newIndex = union_Alloc(union_Default(), sizeof(*newIndex) * cap);
+	if (newIndex == NULL) {
+		return -1;
+	}
+	memset(newIndex, 0, sizeof(*newIndex) * cap);
+	if (font->wordIndex != NULL) {
+		union_Free(union_Default(), font->wordIndex);
+	}
+	font->wordIndex = newIndex;
+	font->capWordIndex = cap;
+	for (Uint32 i = 0; i < font->numCachedWords; i++) {
+		InsertWord(font, i);
+	}
+	return 0;
+}
+
+static int RenderWord(struct font *font, struct word *word)
+{
+	const Color white = { 255, 255, 255, 255 };
+	const Color black = { 0, 0, 0, 0 };
+
+	SDL_Surface *textSurface;
+
+	textSurface = TTF_RenderUTF8_LCD(font->font, word->data, white, black);
 	if (textSurface == NULL) {
-		return NULL;
+		return -1;
 	}
 
-	word.texture = SDL_CreateTextureFromSurface(renderer_Default(), textSurface);
-	if (word.texture == NULL) {
+	word->texture = SDL_CreateTextureFromSurface(renderer_Default(),
+			textSurface);
+	if (word->texture == NULL) {
 		SDL_FreeSurface(textSurface);
-		return NULL;
+		return -1;
 	}
 
-	word.width = textSurface->w;
-	word.height = textSurface->h;
+	word->width = textSurface->w;
+	word->height = textSurface->h;
 
 	SDL_FreeSurface(textSurface);
+	return 0;
+}
+
+/* called on a miss of GetCachedWord() */
+static struct word *CacheWord(struct font *font,
+		const char *text, Uint32 length, Uint32 hash)
+{
+	struct word word;
+	int r;
+
+	if (ReserveWord(font) < 0) {
+		return NULL;
+	}
 
-	len = strlen(data);
-	word.data = union_Alloc(union_Default(), len + 1);
+	word.data = union_Alloc(union_Default(), length + 1);
 	if (word.data == NULL) {
-		SDL_DestroyTexture(word.texture);
 		return NULL;
 	}
-	memcpy(word.data, data, len);
-	word.data[len] = '\0';
+	memcpy(word.data, text, length);
+	word.data[length] = '\0';
+	word.length = length;
+	word.hash = hash;
+
+	trace_Begin("text", "CacheWord", word.data);
+	r = RenderWord(font, &word);
+	trace_End();
+	if (r < 0) {
+		union_Free(union_Default(), word.data);
+		return NULL;
+	}
 
+	word.referenced = true;
+	EvictWords(font, GetWordBytes(&word));
+	font->wordBytes += GetWordBytes(&word);
 	font->cachedWords[font->numCachedWords] = word;
+	InsertWord(font, font->numCachedWords);
 	return &font->cachedWords[font->numCachedWords++];
 }
 
+static struct word *GetWord(struct font *font,
+		const char *text, Uint32 length)
+{
+	const Uint32 hash = HashWord(text, length);
+	struct word *word;
+
+	word = GetCachedWord(font, text, length, hash);
+	if (word != NULL) {
+		batch.stats.numWordHits++;
+		return word;
+	}
+	batch.stats.numWordMisses++;
+	return CacheWord(font, text, length, hash);
+}
+
+#define ATLAS_WIDTH 512
+#define ATLAS_MIN_HEIGHT 128
+#define ATLAS_MAX_HEIGHT 8192
+#define MIN_GLYPH_INDEX 64
+
+static Uint32 HashGlyph(Uint32 ch)
+{
+	/* knuth's multiplicative hash */
+	return ch * 2654435761u;
+}
+
+static struct glyph *FindGlyph(struct atlas *atlas, Uint32 ch)
+{
+	Uint32 mask, slot, entry;
+
+	if (atlas->capIndex == 0) {
+		return NULL;
+	}
+	mask = atlas->capIndex - 1;
+	slot = HashGlyph(ch) & mask;
+	/* the index is never full, so this terminates */
+	while ((entry = atlas->index[slot]) != 0) {
+		if (atlas->glyphs[entry - 1].ch == ch) {
+			return &atlas->glyphs[entry - 1];
+		}
+		slot = (slot + 1) & mask;
+	}
+	return NULL;
+}
+
+static void InsertGlyph(struct atlas *atlas, Uint32 index)
+{
+	Uint32 mask, slot;
+
+	mask = atlas->capIndex - 1;
+	slot = HashGlyph(atlas->glyphs[index].ch) & mask;
+	while (atlas->index[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	atlas->index[slot] = index + 1;
+}
+
+/* makes room for one more glyph in the array and the index */
+static int ReserveGlyph(struct atlas *atlas)
+{
+	struct glyph *newGlyphs;
+	Uint32 *newIndex;
+	Uint32 cap;
+
+	if (atlas->numGlyphs == atlas->capGlyphs) {
+		cap = atlas->capGlyphs * 2 + 64;
+		newGlyphs = union_Realloc(union_Default(), atlas->glyphs,
+				sizeof(*newGlyphs) * cap);
+		if (newGlyphs == NULL) {
+			return -1;
+		}
+		atlas->glyphs = newGlyphs;
+		atlas->capGlyphs = cap;
+	}
+
+	if ((atlas->numGlyphs + 1) * 4 <= atlas->capIndex * 3) {
+		return 0;
+	}
+	for (cap = MIN_GLYPH_INDEX; cap < (atlas->numGlyphs + 1) * 2; ) {
+		cap *= 2;
+	}
+	newIndex = union_Alloc(union_Default(), sizeof(*newIndex) * cap);
+	if (newIndex == NULL) {
+		return -1;
+	}
+	memset(newIndex, 0, sizeof(*newIndex) * cap);
+	if (atlas->index != NULL) {
+		union_Free(union_Default(), atlas->index);
+	}
+	atlas->index = newIndex;
+	atlas->capIndex = cap;
+	for (Uint32 i = 0; i < atlas->numGlyphs; i++) {
+		InsertGlyph(atlas, i);
+	}
+	return 0;
+}
+
+/* makes the atlas at least h pixels high, a static texture cannot be
+ * copied so the new one is filled from the surface */
+static int GrowAtlas(struct atlas *atlas, Sint32 h)
+{
+	SDL_Surface *surface;
+	SDL_Texture *texture;
+	Sint32 height;
+
+	height = atlas->surface == NULL ? ATLAS_MIN_HEIGHT : atlas->surface->h;
+	while (height < h) {
+		height *= 2;
+	}
+	if (height > ATLAS_MAX_HEIGHT) {
+		return -1;
+	}
+	surface = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, height, 32,
+			SDL_PIXELFORMAT_ARGB8888);
+	if (surface == NULL) {
+		return -1;
+	}
+	texture = SDL_CreateTexture(renderer_Default(),
+			SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+			ATLAS_WIDTH, height);
+	if (texture == NULL) {
+		SDL_FreeSurface(surface);
+		return -1;
+	}
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+	if (atlas->surface != NULL) {
+		SDL_SetSurfaceBlendMode(atlas->surface, SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(atlas->surface, NULL, surface, NULL);
+		SDL_FreeSurface(atlas->surface);
+		SDL_DestroyTexture(atlas->texture);
+	}
+	SDL_UpdateTexture(texture, NULL, surface->pixels, surface->pitch);
+	atlas->surface = surface;
+	atlas->texture = texture;
+	return 0;
+}
+
+/* rasterizes a glyph that is not in the atlas yet */
+static struct glyph *AddGlyph(struct font *font, Uint32 ch)
+{
+	const Color white = { 255, 255, 255, 255 };
+	struct atlas *const atlas = &font->atlas;
+	SDL_Surface *surface;
+	struct glyph glyph;
+	SDL_Rect dst;
+	const Uint8 *pixels;
+
+	if (ReserveGlyph(atlas) < 0) {
+		return NULL;
+	}
+	if (TTF_GlyphMetrics32(font->font, ch, NULL, NULL, NULL, NULL,
+				&glyph.advance) < 0) {
+		return NULL;
+	}
+	surface = TTF_RenderGlyph32_Blended(font->font, ch, white);
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	/* glyphs are a pixel apart so that filtering does not bleed */
+	if (atlas->x + surface->w > ATLAS_WIDTH) {
+		atlas->x = 0;
+		atlas->y += atlas->rowHeight + 1;
+		atlas->rowHeight = 0;
+	}
+	if (surface->w > ATLAS_WIDTH || ((atlas->surface == NULL ||
+				atlas->y + surface->h > atlas->surface->h) &&
+			GrowAtlas(atlas, atlas->y + surface->h) < 0)) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	glyph.rect = (SDL_Rect) { atlas->x, atlas->y, surface->w, surface->h };
+	dst = glyph.rect;
+	/* copy the alpha instead of blending it with nothing */
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+	SDL_BlitSurface(surface, NULL, atlas->surface, &dst);
+	SDL_FreeSurface(surface);
+
+	pixels = (const Uint8*) atlas->surface->pixels +
+		glyph.rect.y * atlas->surface->pitch + glyph.rect.x * 4;
+	SDL_UpdateTexture(atlas->texture, &glyph.rect, pixels,
+			atlas->surface->pitch);
+	atlas->x += glyph.rect.w + 1;
+	atlas->rowHeight = MAX(atlas->rowHeight, glyph.rect.h);
+
+	glyph.ch = ch;
+	atlas->glyphs[atlas->numGlyphs] = glyph;
+	InsertGlyph(atlas, atlas->numGlyphs);
+	return &atlas->glyphs[atlas->numGlyphs++];
+}
+
+/* decodes the code point at *index and moves past it, stray bytes are
+ * taken as they are */
+static Uint32 NextCodePoint(const char *text, Uint32 length, Uint32 *index)
+{
+	const Uint8 c = text[(*index)++];
+	Uint32 n, ch;
+
+	if (c < 0xc0) {
+		return c;
+	}
+	n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : 1;
+	ch = c & (0x3f >> n);
+	for (; n > 0 && *index < length &&
+			((Uint8) text[*index] & 0xc0) == 0x80; n--) {
+		ch = (ch << 6) | (text[(*index)++] & 0x3f);
+	}
+	return ch;
+}
+
+/* the same layout as the word backend but glyph by glyph, with draw
+ * false only the extent is computed like renderer_GetTextExtent() */
+static int LayoutGlyphs(struct font *font, const char *text, Uint32 length,
+		Rect *rect, bool draw)
+{
+	SDL_Color color;
+	int advance, tabWidth, lineSkip;
+	Sint32 x, y, cx, cy;
+	Uint32 index, ch, numGlyphs;
+	SDL_Vertex *vertices = NULL;
+	int *indices = NULL;
+	struct glyph *glyph;
+	int result = 0;
+
+	TTF_GlyphMetrics32(font->font, ' ', NULL, NULL, NULL, NULL, &advance);
+	tabWidth = advance * tab_multiplier;
+	lineSkip = TTF_FontLineSkip(font->font);
+
+	x = draw ? rect->x : 0;
+	y = draw ? rect->y : 0;
+	if (draw) {
+		SDL_GetRenderDrawColor(renderer_Default(), &color.r, &color.g,
+				&color.b, &color.a);
+		/* no code point is shorter than a byte */
+		vertices = union_Alloc(union_Frame(),
+				sizeof(*vertices) * 4 * length);
+		indices = union_Alloc(union_Frame(),
+				sizeof(*indices) * 6 * length);
+		if (vertices == NULL || indices == NULL) {
+			result = -1;
+			goto end;
+		}
+	}
+
+	cx = x;
+	cy = y;
+	index = 0;
+	numGlyphs = 0;
+	while (index < length) {
+		ch = NextCodePoint(text, length, &index);
+		switch (ch) {
+		case ' ':
+			cx += advance;
+			continue;
+		case '\t':
+			cx += tabWidth - (cx - x) % tabWidth;
+			continue;
+		case '\n':
+			cx = x;
+			cy += lineSkip;
+			continue;
+		}
+		if (ch < ' ') {
+			continue;
+		}
+		glyph = FindGlyph(&font->atlas, ch);
+		if (glyph == NULL) {
+			glyph = AddGlyph(font, ch);
+			if (glyph == NULL) {
+				result = -1;
+				goto end;
+			}
+		}
+		if (draw) {
+			SDL_Vertex *const v = &vertices[numGlyphs * 4];
+			int *const i = &indices[numGlyphs * 6];
+			const float x1 = cx + batch.dx, y1 = cy + batch.dy;
+			const float x2 = x1 + glyph->rect.w;
+			const float y2 = y1 + glyph->rect.h;
+			const float u1 = glyph->rect.x, v1 = glyph->rect.y;
+			const float u2 = u1 + glyph->rect.w;
+			const float v2 = v1 + glyph->rect.h;
+
+			/* texture coordinates are in pixels until the atlas
+			 * stopped growing */
+			v[0] = (SDL_Vertex) { { x1, y1 }, color, { u1, v1 } };
+			v[1] = (SDL_Vertex) { { x2, y1 }, color, { u2, v1 } };
+			v[2] = (SDL_Vertex) { { x2, y2 }, color, { u2, v2 } };
+			v[3] = (SDL_Vertex) { { x1, y2 }, color, { u1, v2 } };
+			i[0] = numGlyphs * 4;
+			i[1] = numGlyphs * 4 + 1;
+			i[2] = numGlyphs * 4 + 2;
+			i[3] = numGlyphs * 4;
+			i[4] = numGlyphs * 4 + 2;
+			i[5] = numGlyphs * 4 + 3;
+			numGlyphs++;
+		}
+		cx += glyph->advance;
+	}
+
+	if (!draw) {
+		rect->x = cx;
+		rect->y = cy;
+		rect->w = 0;
+		rect->h = lineSkip;
+		goto end;
+	}
+	if (numGlyphs > 0) {
+		const float w = font->atlas.surface->w;
+		const float h = font->atlas.surface->h;
+
+		for (Uint32 i = 0; i < numGlyphs * 4; i++) {
+			vertices[i].tex_coord.x /= w;
+			vertices[i].tex_coord.y /= h;
+		}
+		result = SDL_RenderGeometry(renderer_Default(),
+				font->atlas.texture, vertices, numGlyphs * 4,
+				indices, numGlyphs * 6);
+	}
+	rect->w = cx - rect->x;
+	rect->h = cy + lineSkip - rect->y;
+
+end:
+	if (vertices != NULL) {
+		union_Free(union_Frame(), vertices);
+	}
+	if (indices != NULL) {
+		union_Free(union_Frame(), indices);
+	}
+	return result;
+}
+
 int renderer_DrawText(const char *text, Uint32 length,
 		Rect *rect)
 {
@@ -660,7 +1706,6 @@ int renderer_DrawText(const char *text, Uint32 length,
 	Uint8 r, g, b, a;
 	int advance, tabWidth, lineSkip;
 	Sint32 cx, cy;
-	char *data = NULL, *newData;
 	struct word *word;
 	Rect textRect;
 	Uint32 index, end;
@@ -668,9 +1713,15 @@ int renderer_DrawText(const char *text, Uint32 length,
 	if (num_fonts == 0) {
 		return 1;
 	}
+	RecordText(text, length, rect->x, rect->y);
 
 	font = &cached_fonts[cur_font];
 
+	/* text is drawn directly and has to stay above queued primitives */
+	renderer_Flush();
+	if (text_backend == TEXT_BACKEND_ATLAS) {
+		return LayoutGlyphs(font, text, length, rect, true);
+	}
 	SDL_GetRenderDrawColor(renderer_Default(), &r, &g, &b, &a);
 
 	TTF_GlyphMetrics32(font->font, ' ', NULL, NULL, NULL, NULL, &advance);
@@ -713,36 +1764,19 @@ int renderer_DrawText(const char *text, Uint32 length,
 			end++;
 		}
 
-		newData = union_Realloc(union_Default(), data, end - index + 1);
-		if (newData == NULL) {
-			union_Free(union_Default(), data);
-			return -1;
-		}
-		data = newData;
-
-		memcpy(data, &text[index], end - index);
-		data[end - index] = '\0';
-		word = GetCachedWord(data);
-
+		word = GetWord(font, &text[index], end - index);
 		if (word == NULL) {
-			word = CacheWord(data);
-			if (word == NULL) {
-				union_Free(union_Default(), data);
-				return -1;
-			}
+			return -1;
 		}
 
 		textRect = (Rect) {
-			cx, cy, word->width, word->height
+			cx + batch.dx, cy + batch.dy, word->width, word->height
 		};
 		SDL_SetTextureColorMod(word->texture, r, g, b);
 		SDL_RenderCopy(renderer_Default(), word->texture, NULL, &textRect);
 		cx += word->width;
 		index = end;
 	}
-	if (data != NULL) {
-		union_Free(union_Default(), data);
-	}
 	rect->w = cx - rect->x;
 	rect->h = cy + lineSkip - rect->y;
 	return 0;
@@ -755,7 +1789,6 @@ int renderer_GetTextExtent(const char *text, Uint32 length,
 	int advance, tabWidth, lineSkip;
 	Sint32 cx, cy;
 	Uint32 index, end;
-	char *data = NULL, *newData;
 	struct word *word;
 
 	if (num_fonts == 0) {
@@ -763,6 +1796,9 @@ int renderer_GetTextExtent(const char *text, Uint32 length,
 	}
 
 	font = &cached_fonts[cur_font];
+	if (text_backend == TEXT_BACKEND_ATLAS) {
+		return LayoutGlyphs(font, text, length, rect, false);
+	}
 
 	TTF_GlyphMetrics32(font->font, ' ', NULL, NULL, NULL, NULL, &advance);
 	tabWidth = advance * tab_multiplier;
@@ -804,30 +1840,13 @@ int renderer_GetTextExtent(const char *text, Uint32 length,
 			end++;
 		}
 
-		newData = union_Realloc(union_Default(), data, end - index + 1);
-		if (newData == NULL) {
-			union_Free(union_Default(), data);
-			return -1;
-		}
-		data = newData;
-
-		memcpy(data, &text[index], end - index);
-		data[end - index] = '\0';
-		word = GetCachedWord(data);
-
+		word = GetWord(font, &text[index], end - index);
 		if (word == NULL) {
-			word = CacheWord(data);
-			if (word == NULL) {
-				union_Free(union_Default(), data);
-				return -1;
-			}
+			return -1;
 		}
 		cx += word->width;
 		index = end;
 	}
-	if (data != NULL) {
-		union_Free(union_Default(), data);
-	}
 	rect->x = cx;
 	rect->y = cy;
 	rect->w = 0;
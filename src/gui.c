@@ -5,6 +5,65 @@ SDL_Renderer *gui_renderer;
 const Uint8 *gui_keys;
 bool gui_running;
 
+static Sint32 gui_initWidth = 640;
+static Sint32 gui_initHeight = 480;
+/* what the software renderer draws into without a window */
+static SDL_Surface *gui_framebuffer;
+
+/* microseconds per frame the garbage collector may take */
+#define GC_BUDGET 1000
+
+/* damage is collected in one region while the other is painted, so
+ * that invalidating from a draw function repaints in the next frame */
+static Region gui_damage[2];
+static Uint32 gui_curDamage;
+/* window contents that survive between frames, NULL when the renderer
+ * cannot render to textures and every frame repaints everything */
+static SDL_Texture *gui_canvas;
+
+#define DEFAULT_FRAME_RATE 60
+
+/* in performance counter units, 0 paints as soon as there is damage */
+static Uint64 gui_frameLength;
+/* performance counter value the loop has to wake up at, 0 for none */
+static Uint64 gui_wake;
+
+/* frames whose phase times are kept for the percentiles */
+#define FRAME_HISTORY 256
+
+const char *gui_phaseNames[FRAME_PHASE_MAX] = {
+	[FRAME_PHASE_PUMP] = "pump",
+	[FRAME_PHASE_DISPATCH] = "dispatch",
+	[FRAME_PHASE_PAINT] = "paint",
+	[FRAME_PHASE_SCRIPT] = "script",
+	[FRAME_PHASE_PRESENT] = "present",
+	[FRAME_PHASE_GC] = "gc",
+};
+
+static struct frame_timing {
+	frame_phase_t phase;
+	Uint64 start;
+	/* performance counter units of the current frame, including the
+	 * idle phase which is dropped */
+	Uint64 times[FRAME_PHASE_MAX + 1];
+	/* microseconds of the last frames, a ring indexed by numFrames */
+	Uint32 history[FRAME_PHASE_MAX][FRAME_HISTORY];
+	Uint32 totals[FRAME_HISTORY];
+	Uint32 numFrames;
+	bool overlay;
+} gui_timing = { .phase = FRAME_PHASE_IDLE };
+
+/* damage with more rects is painted through its bounds at once */
+#define PAINT_RECTS 16
+
+/* bytes of view cache textures, least recently used ones are evicted
+ * to stay below the budget */
+#define CACHE_BUDGET (64 << 20)
+static Size gui_cacheBytes;
+/* counts painted frames to tell when a cache was used last */
+static Uint64 gui_frame;
+static bool gui_painting;
+
 int button_Proc(View *view, event_t event, EventInfo *info);
 
 Renderer *renderer_Default(void)
@@ -12,45 +71,189 @@ Renderer *renderer_Default(void)
 	return gui_renderer;
 }
 
+static void GetWindowRect(Rect *rect)
+{
+	rect->x = 0;
+	rect->y = 0;
+	if (SDL_GetRendererOutputSize(gui_renderer, &rect->w, &rect->h) < 0) {
+		SDL_GetWindowSize(gui_window, &rect->w, &rect->h);
+	}
+}
+
 Sint32 gui_GetWindowWidth(void)
 {
-	int w, h;
+	Rect window;
 
-	SDL_GetWindowSize(gui_window, &w, &h);
-	return w;
+	GetWindowRect(&window);
+	return window.w;
 }
 
 Sint32 gui_GetWindowHeight(void)
 {
-	int w, h;
+	Rect window;
 
-	SDL_GetWindowSize(gui_window, &w, &h);
-	return h;
+	GetWindowRect(&window);
+	return window.h;
 }
 
-int gui_Init(Uint32 flags)
+void gui_SetInitSize(Sint32 w, Sint32 h)
+{
+	gui_initWidth = w;
+	gui_initHeight = h;
+}
+
+void gui_SetFrameRate(Uint32 fps)
+{
+	gui_frameLength = fps == 0 ? 0 :
+		SDL_GetPerformanceFrequency() / fps;
+}
+
+void gui_WakeAt(Uint64 counter)
+{
+	if (gui_wake == 0 || counter < gui_wake) {
+		gui_wake = counter;
+	}
+}
+
+frame_phase_t gui_EnterPhase(frame_phase_t phase)
+{
+	const frame_phase_t prev = gui_timing.phase;
+	Uint64 now;
+
+	if (phase == prev) {
+		return prev;
+	}
+	now = SDL_GetPerformanceCounter();
+	gui_timing.times[prev] += now - gui_timing.start;
+	gui_timing.start = now;
+	gui_timing.phase = phase;
+	return prev;
+}
+
+static void EndFrame(void)
 {
-	(void) flags;
+	const Uint64 freq = SDL_GetPerformanceFrequency();
+	const Uint32 index = gui_timing.numFrames % FRAME_HISTORY;
+	Uint64 total = 0;
+
+	/* counts the running phase up to now */
+	gui_EnterPhase(gui_EnterPhase(FRAME_PHASE_IDLE));
+	for (Uint32 i = 0; i < FRAME_PHASE_MAX; i++) {
+		const Uint64 t = gui_timing.times[i] * 1000000 / freq;
+
+		gui_timing.history[i][index] = MIN(t, (Uint64) UINT32_MAX);
+		total += t;
+	}
+	gui_timing.totals[index] = MIN(total, (Uint64) UINT32_MAX);
+	gui_timing.numFrames++;
+	memset(gui_timing.times, 0, sizeof(gui_timing.times));
+}
+
+static int CompareTimes(const void *a, const void *b)
+{
+	const Uint32 t1 = *(const Uint32*) a, t2 = *(const Uint32*) b;
+
+	return t1 < t2 ? -1 : t1 > t2;
+}
+
+static void GetPhaseStats(const Uint32 *history, Uint32 num,
+		PhaseStats *stats)
+{
+	Uint32 sorted[FRAME_HISTORY];
+
+	if (num == 0) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	memcpy(sorted, history, sizeof(*sorted) * num);
+	qsort(sorted, num, sizeof(*sorted), CompareTimes);
+	stats->p50 = sorted[(num - 1) * 50 / 100];
+	stats->p95 = sorted[(num - 1) * 95 / 100];
+	stats->p99 = sorted[(num - 1) * 99 / 100];
+	stats->max = sorted[num - 1];
+}
+
+void gui_GetFrameStats(FrameStats *stats)
+{
+	const Uint32 num = MIN(gui_timing.numFrames, (Uint32) FRAME_HISTORY);
+
+	stats->numFrames = num;
+	for (Uint32 i = 0; i < FRAME_PHASE_MAX; i++) {
+		GetPhaseStats(gui_timing.history[i], num, &stats->phases[i]);
+	}
+	GetPhaseStats(gui_timing.totals, num, &stats->total);
+}
+
+void gui_SetFrameOverlay(bool show)
+{
+	gui_timing.overlay = show;
+	gui_Invalidate(NULL);
+}
+
+bool gui_HasFrameOverlay(void)
+{
+	return gui_timing.overlay;
+}
+
+bool gui_IsPainting(void)
+{
+	return gui_painting;
+}
+
+void gui_Invalidate(const Rect *rect)
+{
+	Rect window;
+	Rect r;
+
+	if (gui_renderer == NULL) {
+		return;
+	}
+	GetWindowRect(&window);
+	if (rect == NULL) {
+		r = window;
+	} else if (!rect_Intersect(rect, &window, &r)) {
+		return;
+	}
+	region_AddRect(&gui_damage[gui_curDamage], &r);
+}
 
-	srand(time(NULL));
+static int CreateHeadless(void)
+{
+	/* the dummy driver needs no display but still gives events */
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
 	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
 		printf("SDL could not be initialized: %s\n", SDL_GetError());
 		return 1;
 	}
-
-	if (TTF_Init() < 0) {
-		printf("SDL_ttf could not be initialized: %s\n", TTF_GetError());
+	gui_framebuffer = SDL_CreateRGBSurfaceWithFormat(0,
+			gui_initWidth, gui_initHeight, 32,
+			SDL_PIXELFORMAT_ARGB8888);
+	if (gui_framebuffer == NULL) {
+		printf("SDL framebuffer could not be created: %s\n",
+				SDL_GetError());
 		return 1;
 	}
+	gui_renderer = SDL_CreateSoftwareRenderer(gui_framebuffer);
+	if (gui_renderer == NULL) {
+		printf("SDL gui_renderer could not be created: %s\n",
+				SDL_GetError());
+		return 1;
+	}
+	return 0;
+}
 
-	gui_keys = SDL_GetKeyboardState(NULL);
-
+static int CreateWindow(void)
+{
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		printf("SDL could not be initialized: %s\n", SDL_GetError());
+		return 1;
+	}
 	gui_window = SDL_CreateWindow(
 		"My SDL2 Window",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		640,
-		480,
+		gui_initWidth,
+		gui_initHeight,
 		SDL_WINDOW_SHOWN
 	);
 	if (gui_window == NULL) {
@@ -59,6 +262,43 @@ int gui_Init(Uint32 flags)
 	}
 	gui_renderer = SDL_CreateRenderer(gui_window, -1,
 			SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (gui_renderer == NULL) {
+		printf("SDL gui_renderer could not be created: %s\n",
+				SDL_GetError());
+		return 1;
+	}
+	return 0;
+}
+
+int gui_Init(Uint32 flags)
+{
+	if (flags & GUI_INIT_HEADLESS) {
+		/* headless runs are for tests and have to be reproducible */
+		srand(0);
+		if (CreateHeadless() != 0) {
+			return 1;
+		}
+	} else {
+		srand(time(NULL));
+		if (CreateWindow() != 0) {
+			return 1;
+		}
+	}
+
+	if (TTF_Init() < 0) {
+		printf("SDL_ttf could not be initialized: %s\n", TTF_GetError());
+		return 1;
+	}
+
+	gui_keys = SDL_GetKeyboardState(NULL);
+	gui_running = true;
+
+	for (Uint32 i = 0; i < ARRLEN(gui_damage); i++) {
+		region_Init(&gui_damage[i], union_Default());
+		gui_damage[i].flags = REGION_OPTIMIZE;
+	}
+	gui_Invalidate(NULL);
+	gui_SetFrameRate(DEFAULT_FRAME_RATE);
 	return 0;
 }
 
@@ -111,6 +351,21 @@ static int TranslateEvent(const SDL_Event *event,
 		break;
 	case SDL_TEXTEDITING:
 		break;
+	case SDL_WINDOWEVENT:
+		switch (event->window.event) {
+		case SDL_WINDOWEVENT_SIZE_CHANGED:
+			if (gui_canvas != NULL) {
+				SDL_DestroyTexture(gui_canvas);
+				gui_canvas = NULL;
+			}
+			/* views may draw relative to the window size */
+			view_InvalidateAll();
+			break;
+		case SDL_WINDOWEVENT_EXPOSED:
+			gui_Invalidate(NULL);
+			break;
+		}
+		return 1;
 	case SDL_QUIT:
 		gui_running = false;
 		/* fall through */
@@ -120,39 +375,513 @@ static int TranslateEvent(const SDL_Event *event,
 	return 0;
 }
 
-int gui_Run(void)
+struct paint_list {
+	View **views;
+	RectArray rects;
+	Uint32 capViews;
+};
+
+/* collects the views in the order view_SendRecursive() visits them,
+ * views without a size may draw anywhere and get the window rect */
+static int CollectViews(View *view, const Rect *window,
+		struct paint_list *list)
+{
+	Union *const uni = union_Frame();
+	Uint32 n;
+
+	for (; view != NULL; view = view->next) {
+		/* cached views paint their children themselves */
+		if ((!(view->flags & VIEW_FLAG_CACHED) ||
+					rect_IsEmpty(&view->rect)) &&
+				CollectViews(view->child, window, list) < 0) {
+			return -1;
+		}
+		if (view->label == NULL) {
+			continue;
+		}
+		n = list->rects.numRects;
+		if (n == list->capViews) {
+			list->capViews = list->capViews * 2 + 16;
+			list->views = union_Realloc(uni, list->views,
+					sizeof(*list->views) * list->capViews);
+			list->rects.x = union_Realloc(uni, list->rects.x,
+					sizeof(Sint32) * list->capViews);
+			list->rects.y = union_Realloc(uni, list->rects.y,
+					sizeof(Sint32) * list->capViews);
+			list->rects.w = union_Realloc(uni, list->rects.w,
+					sizeof(Sint32) * list->capViews);
+			list->rects.h = union_Realloc(uni, list->rects.h,
+					sizeof(Sint32) * list->capViews);
+			if (list->views == NULL || list->rects.x == NULL ||
+					list->rects.y == NULL ||
+					list->rects.w == NULL ||
+					list->rects.h == NULL) {
+				return -1;
+			}
+		}
+		const Rect *const r = rect_IsEmpty(&view->rect) ?
+			window : &view->rect;
+		list->views[n] = view;
+		list->rects.x[n] = r->x;
+		list->rects.y[n] = r->y;
+		list->rects.w[n] = r->w;
+		list->rects.h[n] = r->h;
+		list->rects.numRects++;
+	}
+	return 0;
+}
+
+/* paints the view itself, ignoring its cache */
+static void PaintContents(View *view)
+{
+	if (!(view->flags & VIEW_FLAG_RECORD)) {
+		view_Send(view, EVENT_PAINT, NULL);
+		return;
+	}
+	if (view->list.valid) {
+		renderer_Replay(&view->list);
+		return;
+	}
+	renderer_BeginRecord(&view->list);
+	view_Send(view, EVENT_PAINT, NULL);
+	renderer_EndRecord();
+}
+
+void gui_FreeCache(View *view)
+{
+	int w, h;
+
+	if (view->cache == NULL) {
+		return;
+	}
+	if (SDL_QueryTexture(view->cache, NULL, NULL, &w, &h) == 0) {
+		gui_cacheBytes -= (Size) w * h * 4;
+	}
+	SDL_DestroyTexture(view->cache);
+	view->cache = NULL;
+	view->cacheValid = false;
+}
+
+static View *FindLeastUsed(View *view, View *least)
+{
+	for (; view != NULL; view = view->next) {
+		least = FindLeastUsed(view->child, least);
+		/* caches used in this frame may still be needed */
+		if (view->cache != NULL && view->cacheUsed < gui_frame &&
+				(least == NULL ||
+				 view->cacheUsed < least->cacheUsed)) {
+			least = view;
+		}
+	}
+	return least;
+}
+
+/* makes sure the view has a texture of the size of its rect */
+static int ReserveCache(View *view)
+{
+	const Size bytes = (Size) view->rect.w * view->rect.h * 4;
+	int w, h;
+	View *least;
+
+	if (view->cache != NULL) {
+		if (SDL_QueryTexture(view->cache, NULL, NULL, &w, &h) == 0 &&
+				w == view->rect.w && h == view->rect.h) {
+			return 0;
+		}
+		/* the rect was changed with a texture of the old size */
+		gui_FreeCache(view);
+	}
+	if (bytes > CACHE_BUDGET) {
+		return -1;
+	}
+	while (gui_cacheBytes + bytes > CACHE_BUDGET) {
+		least = FindLeastUsed(view_Default(), NULL);
+		if (least == NULL) {
+			return -1;
+		}
+		gui_FreeCache(least);
+	}
+	view->cache = SDL_CreateTexture(gui_renderer, SDL_PIXELFORMAT_RGBA8888,
+			SDL_TEXTUREACCESS_TARGET, view->rect.w, view->rect.h);
+	if (view->cache == NULL) {
+		return -1;
+	}
+	SDL_SetTextureBlendMode(view->cache, SDL_BLENDMODE_BLEND);
+	gui_cacheBytes += bytes;
+	return 0;
+}
+
+static void PaintView(View *view);
+
+static void PaintTree(View *view)
+{
+	for (; view != NULL; view = view->next) {
+		if (!(view->flags & VIEW_FLAG_CACHED)) {
+			PaintTree(view->child);
+		}
+		if (view->label != NULL) {
+			PaintView(view);
+		}
+	}
+}
+
+/* paints the view and its children into its cache, the renderer offset
+ * moves the top left of the view rect to the top left of the texture */
+static int RenderCache(View *view)
+{
+	SDL_Texture *target;
+	SDL_Rect clip;
+	bool clipped;
+	Sint32 dx, dy;
+
+	if (ReserveCache(view) < 0) {
+		return -1;
+	}
+	renderer_Flush();
+	target = SDL_GetRenderTarget(gui_renderer);
+	clipped = SDL_RenderIsClipEnabled(gui_renderer);
+	SDL_RenderGetClipRect(gui_renderer, &clip);
+	if (SDL_SetRenderTarget(gui_renderer, view->cache) < 0) {
+		return -1;
+	}
+	renderer_GetOffset(&dx, &dy);
+	SDL_RenderSetClipRect(gui_renderer, NULL);
+	SDL_SetRenderDrawColor(gui_renderer, 0, 0, 0, 0);
+	SDL_RenderClear(gui_renderer);
+	/* view rects are absolute, not relative to an enclosing cache */
+	renderer_SetOffset(-view->rect.x, -view->rect.y);
+
+	PaintTree(view->child);
+	if (view->label != NULL) {
+		PaintContents(view);
+	}
+
+	renderer_Flush();
+	renderer_SetOffset(dx, dy);
+	SDL_SetRenderTarget(gui_renderer, target);
+	SDL_RenderSetClipRect(gui_renderer, clipped ? &clip : NULL);
+	view->cacheValid = true;
+	return 0;
+}
+
+static void PaintView(View *view)
+{
+	if ((view->flags & VIEW_FLAG_CACHED) && !rect_IsEmpty(&view->rect)) {
+		if (view->cacheValid || RenderCache(view) == 0) {
+			view->cacheUsed = gui_frame;
+			renderer_DrawTexture(view->cache, &view->rect);
+			return;
+		}
+		/* without a texture, paint like any other view */
+		PaintTree(view->child);
+	}
+	PaintContents(view);
+}
+
+/* clears the rect and repaints the views that overlap it with drawing
+ * clipped to it */
+static void PaintRect(const Rect *clip, const struct paint_list *list,
+		Uint32 *mask)
+{
+	renderer_Flush();
+	SDL_RenderSetClipRect(gui_renderer, clip);
+	SDL_SetRenderDrawColor(gui_renderer, 0, 0, 0, 255);
+	SDL_RenderFillRect(gui_renderer, clip);
+	if (mask != NULL) {
+		rect_OverlapMask(clip, &list->rects, mask);
+	}
+	for (Uint32 i = 0; i < list->rects.numRects; i++) {
+		if (mask != NULL && !(mask[i / 32] & (1u << (i % 32)))) {
+			continue;
+		}
+		PaintView(list->views[i]);
+	}
+}
+
+/* repaints the views that intersect the damage into the canvas which is
+ * then presented as a whole; each damage rect is cleared and painted on
+ * its own so that nothing between them changes, unless there are so many
+ * that painting their bounds at once is cheaper */
+static void Paint(void)
+{
+	Region *const damage = &gui_damage[gui_curDamage];
+	Rect window;
+	struct paint_list list;
+	Uint32 *mask;
+	bool onCanvas;
+
+	/* anything drawn outside of painting is dropped with the frame */
+	renderer_Flush();
+	GetWindowRect(&window);
+	if (gui_canvas == NULL) {
+		gui_canvas = SDL_CreateTexture(gui_renderer,
+				SDL_PIXELFORMAT_RGBA8888,
+				SDL_TEXTUREACCESS_TARGET, window.w, window.h);
+		/* the canvas replaces the back buffer instead of blending
+		 * over what it had before */
+		if (gui_canvas != NULL) {
+			SDL_SetTextureBlendMode(gui_canvas, SDL_BLENDMODE_NONE);
+		}
+	}
+	onCanvas = gui_canvas != NULL &&
+		SDL_SetRenderTarget(gui_renderer, gui_canvas) == 0;
+	if (!onCanvas) {
+		/* without a canvas, the previous frame is lost */
+		region_SetRect(damage, &window);
+	}
+
+	gui_curDamage ^= 1;
+	gui_frame++;
+
+	gui_painting = true;
+	memset(&list, 0, sizeof(list));
+	if (CollectViews(view_Default(), &window, &list) < 0) {
+		/* paint everything rather than nothing */
+		SDL_RenderSetClipRect(gui_renderer, &damage->bounds);
+		SDL_SetRenderDrawColor(gui_renderer, 0, 0, 0, 255);
+		SDL_RenderFillRect(gui_renderer, &damage->bounds);
+		view_SendRecursive(view_Default(), EVENT_PAINT, NULL);
+	} else {
+		/* with no views, the damage is still cleared */
+		mask = list.rects.numRects == 0 ? NULL :
+			union_Alloc(union_Frame(), sizeof(*mask) *
+				((list.rects.numRects + 31) / 32));
+		if (damage->bits != NULL || damage->numRects > PAINT_RECTS) {
+			PaintRect(&damage->bounds, &list, mask);
+		} else {
+			for (Uint32 i = 0; i < damage->numRects; i++) {
+				PaintRect(&damage->rects[i], &list, mask);
+			}
+		}
+	}
+
+	gui_painting = false;
+	renderer_Flush();
+	gui_EnterPhase(FRAME_PHASE_PRESENT);
+	SDL_RenderSetClipRect(gui_renderer, NULL);
+	if (onCanvas) {
+		SDL_SetRenderTarget(gui_renderer, NULL);
+		SDL_RenderCopy(gui_renderer, gui_canvas, NULL, NULL);
+	}
+	SDL_RenderPresent(gui_renderer);
+	region_SetEmpty(damage);
+}
+
+static void FreeCaches(View *view)
+{
+	for (; view != NULL; view = view->next) {
+		FreeCaches(view->child);
+		gui_FreeCache(view);
+	}
+}
+
+/* milliseconds until the next frame is due or -1 when the loop can
+ * sleep until an event comes */
+static int GetTimeout(Uint64 lastFrame)
+{
+	const Uint64 now = SDL_GetPerformanceCounter();
+	const Uint64 freq = SDL_GetPerformanceFrequency();
+	Uint64 due;
+
+	if (!rect_IsEmpty(&gui_damage[gui_curDamage].bounds)) {
+		due = lastFrame + gui_frameLength;
+	} else if (gui_wake != 0) {
+		due = MAX(gui_wake, lastFrame + gui_frameLength);
+	} else {
+		return -1;
+	}
+	if (due <= now) {
+		return 0;
+	}
+	/* round up so the loop does not wake just before it is due */
+	return MIN((due - now) * 1000 / freq + 1, (Uint64) INT32_MAX);
+}
+
+/* sends EVENT_TIMER to the views whose timer is due and wakes the loop
+ * for the next one */
+static void RunTimers(View *view, Uint64 now)
+{
+	EventInfo info;
+
+	for (; view != NULL; view = view->next) {
+		RunTimers(view->child, now);
+		if (view->timer == 0) {
+			continue;
+		}
+		if (view->timer > now) {
+			gui_WakeAt(view->timer);
+			continue;
+		}
+		view->timer = 0;
+		if (view->label != NULL) {
+			memset(&info, 0, sizeof(info));
+			view_Send(view, EVENT_TIMER, &info);
+		}
+	}
+}
+
+static void HandleEvent(const SDL_Event *event)
 {
-	Uint64 start, end, ticks;
-	SDL_Event event;
 	event_t type;
 	EventInfo info;
+	frame_phase_t phase;
+
+	phase = gui_EnterPhase(FRAME_PHASE_DISPATCH);
+	if (TranslateEvent(event, &type, &info) == 0) {
+		view_SendRecursive(view_Default(), type, &info);
+	}
+	gui_EnterPhase(phase);
+}
+
+/* runs the timers that are due and paints the damage, returns whether
+ * there was anything to do */
+static bool RunFrame(Uint64 now)
+{
+	const bool timers = gui_wake != 0 && now >= gui_wake;
+
+	if (!timers && rect_IsEmpty(&gui_damage[gui_curDamage].bounds)) {
+		return false;
+	}
+	trace_Begin("gui", "frame", NULL);
+	if (timers) {
+		gui_wake = 0;
+		gui_EnterPhase(FRAME_PHASE_DISPATCH);
+		trace_Begin("gui", "timers", NULL);
+		RunTimers(view_Default(), now);
+		trace_End();
+	}
+	/* timers may have damaged something */
+	if (!rect_IsEmpty(&gui_damage[gui_curDamage].bounds)) {
+		gui_EnterPhase(FRAME_PHASE_PAINT);
+		trace_Begin("gui", "paint", NULL);
+		Paint();
+		trace_End();
+	}
+	trace_End();
+	return true;
+}
+
+int gui_Run(void)
+{
+	Uint64 lastFrame, now;
+	SDL_Event event;
+	int timeout;
+	bool ran;
 
 	SDL_StartTextInput();
-	start = SDL_GetTicks64();
+	lastFrame = 0;
 	gui_running = true;
 	while (gui_running) {
-		SDL_SetRenderDrawColor(gui_renderer, 0, 0, 0, 0);
-		SDL_RenderClear(gui_renderer);
-		end = SDL_GetTicks64();
-		ticks = end - start;
-		start = end;
-
-		type = EVENT_NULL;
+		union_Reset(union_Frame());
 
+		/* block while there is nothing to paint */
+		timeout = GetTimeout(lastFrame);
+		gui_EnterPhase(FRAME_PHASE_IDLE);
+		if (timeout != 0 && SDL_WaitEventTimeout(&event, timeout)) {
+			HandleEvent(&event);
+		}
+		gui_EnterPhase(FRAME_PHASE_PUMP);
 		while (SDL_PollEvent(&event)) {
-			if (TranslateEvent(&event, &type, &info) == 0) {
-				view_SendRecursive(view_Default(), type, &info);
-			}
+			HandleEvent(&event);
 		}
 
-		(void) ticks;
-		view_SendRecursive(view_Default(), EVENT_PAINT, NULL);
+		/* timers and painting both happen at most once a frame, time
+		 * of loops without either goes into the next frame */
+		now = SDL_GetPerformanceCounter();
+		ran = now >= lastFrame + gui_frameLength && RunFrame(now);
+		if (ran) {
+			lastFrame = now;
+		}
+
+		gui_EnterPhase(FRAME_PHASE_GC);
+		environment_GC(GC_BUDGET);
+		if (ran) {
+			EndFrame();
+		}
+	}
+	gui_EnterPhase(FRAME_PHASE_IDLE);
+	gui_Quit();
+	return 0;
+}
+
+bool gui_Step(void)
+{
+	SDL_Event event;
 
-		SDL_RenderPresent(gui_renderer);
+	union_Reset(union_Frame());
+	gui_EnterPhase(FRAME_PHASE_PUMP);
+	while (SDL_PollEvent(&event)) {
+		HandleEvent(&event);
+	}
+	RunFrame(SDL_GetPerformanceCounter());
+	gui_EnterPhase(FRAME_PHASE_GC);
+	environment_GC(GC_BUDGET);
+	EndFrame();
+	gui_EnterPhase(FRAME_PHASE_IDLE);
+	return gui_running;
+}
+
+void gui_Quit(void)
+{
+	trace_Stop();
+	FreeCaches(view_Default());
+	if (gui_canvas != NULL) {
+		SDL_DestroyTexture(gui_canvas);
+		gui_canvas = NULL;
 	}
 	SDL_DestroyRenderer(gui_renderer);
-	SDL_DestroyWindow(gui_window);
+	gui_renderer = NULL;
+	if (gui_window != NULL) {
+		SDL_DestroyWindow(gui_window);
+		gui_window = NULL;
+	}
+	if (gui_framebuffer != NULL) {
+		SDL_FreeSurface(gui_framebuffer);
+		gui_framebuffer = NULL;
+	}
 	SDL_Quit();
-	return 0;
 }
 
+SDL_Surface *gui_ReadFrame(void)
+{
+	SDL_Texture *target;
+	SDL_Surface *surface;
+	Rect window;
+	int result;
+
+	renderer_Flush();
+	GetWindowRect(&window);
+	surface = SDL_CreateRGBSurfaceWithFormat(0, window.w, window.h, 32,
+			SDL_PIXELFORMAT_ARGB8888);
+	if (surface == NULL) {
+		return NULL;
+	}
+	/* the canvas keeps the frame after it was presented, the back
+	 * buffer of a window does not */
+	target = SDL_GetRenderTarget(gui_renderer);
+	if (gui_canvas != NULL) {
+		SDL_SetRenderTarget(gui_renderer, gui_canvas);
+	}
+	result = SDL_RenderReadPixels(gui_renderer, NULL,
+			SDL_PIXELFORMAT_ARGB8888, surface->pixels, surface->pitch);
+	SDL_SetRenderTarget(gui_renderer, target);
+	if (result < 0) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	return surface;
+}
+
+int gui_SaveFrame(const char *path)
+{
+	SDL_Surface *surface;
+	int result;
+
+	surface = gui_ReadFrame();
+	if (surface == NULL) {
+		return -1;
+	}
+	result = IMG_SavePNG(surface, path);
+	SDL_FreeSurface(surface);
+	return result;
+}
@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <inttypes.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
@@ -36,11 +37,84 @@ typedef SDL_Rect Rect;
 typedef SDL_Point Point;
 
 #define GUI_INIT_CLASSES 0x01
+/* renders into a software framebuffer without a window, so that no
+ * display or gpu is needed, frames are driven with gui_Step() */
+#define GUI_INIT_HEADLESS 0x02
 
+/* size of the window or headless framebuffer, before gui_Init() */
+void gui_SetInitSize(Sint32 w, Sint32 h);
 int gui_Init(Uint32 flags);
 Sint32 gui_GetWindowWidth(void);
 Sint32 gui_GetWindowHeight(void);
 int gui_Run(void);
+/* one iteration of the loop without waiting or frame pacing: handles
+ * pending events, runs due timers and paints the damage; returns false
+ * once the program should quit */
+bool gui_Step(void);
+/* releases what gui_Init() created, gui_Run() does this on return */
+void gui_Quit(void);
+/* copies the last painted frame into a new ARGB8888 surface */
+SDL_Surface *gui_ReadFrame(void);
+int gui_SaveFrame(const char *path);
+/* adds a rect in window coordinates to what the next frame repaints,
+ * NULL invalidates the whole window */
+void gui_Invalidate(const Rect *rect);
+/* whether views are being painted, stores made by painting damage
+ * nothing */
+bool gui_IsPainting(void);
+/* the loop sleeps until an event, a timer or damage, and then runs
+ * timers and paints at most fps times a second (0 for no limit) */
+void gui_SetFrameRate(Uint32 fps);
+/* wakes the loop at a performance counter value */
+void gui_WakeAt(Uint64 counter);
+
+/* every moment of a frame is counted for exactly one phase, scripts run
+ * from an event or a paint count as script and not as the phase around
+ * them */
+typedef enum {
+	FRAME_PHASE_PUMP,
+	FRAME_PHASE_DISPATCH,
+	FRAME_PHASE_PAINT,
+	FRAME_PHASE_SCRIPT,
+	FRAME_PHASE_PRESENT,
+	FRAME_PHASE_GC,
+	FRAME_PHASE_MAX,
+	/* waiting for events, not part of any frame */
+	FRAME_PHASE_IDLE = FRAME_PHASE_MAX,
+} frame_phase_t;
+
+/* microseconds over the last frames */
+typedef struct phase_stats {
+	Uint32 p50;
+	Uint32 p95;
+	Uint32 p99;
+	Uint32 max;
+} PhaseStats;
+
+typedef struct frame_stats {
+	/* frames the percentiles are taken from */
+	Uint32 numFrames;
+	PhaseStats phases[FRAME_PHASE_MAX];
+	PhaseStats total;
+} FrameStats;
+
+extern const char *gui_phaseNames[FRAME_PHASE_MAX];
+
+/* time from now on is counted for phase, returns the previous phase */
+frame_phase_t gui_EnterPhase(frame_phase_t phase);
+void gui_GetFrameStats(FrameStats *stats);
+/* the console draws the frame stats over everything while set */
+void gui_SetFrameOverlay(bool show);
+bool gui_HasFrameOverlay(void);
+
+/* writes chrome trace events (chrome://tracing, ui.perfetto.dev) to a
+ * json file until trace_Stop(), spans nest and the calls do nothing
+ * while no trace is running; detail may be NULL */
+int trace_Start(const char *path);
+void trace_Stop(void);
+bool trace_IsRunning(void);
+void trace_Begin(const char *category, const char *name, const char *detail);
+void trace_End(void);
 
 typedef struct {
 	float alpha;
@@ -83,21 +157,113 @@ int renderer_DrawLine(Sint32 x1, Sint32 y1,
 int renderer_DrawEllipse(Sint32 x, Sint32 y, Sint32 rx, Sint32 ry);
 int renderer_FillEllipse(Sint32 x, Sint32 y, Sint32 rx, Sint32 ry);
 
+typedef struct renderer_stats {
+	/* primitives queued and the SDL calls that drew them */
+	Uint64 numPrimitives;
+	Uint64 numBatches;
+	Uint64 numFlushes;
+	/* ellipses whose shape was cached or had to be traced */
+	Uint64 numShapeHits;
+	Uint64 numShapeMisses;
+	/* display lists recorded and replayed */
+	Uint64 numRecords;
+	Uint64 numReplays;
+	/* words of text found in the cache of their font or rendered */
+	Uint64 numWordHits;
+	Uint64 numWordMisses;
+	Uint64 numWordEvictions;
+	/* what the word caches of all fonts hold right now */
+	Uint64 numWords;
+	Uint64 wordBytes;
+} RendererStats;
+
+/* the renderer calls made while painting a view */
+typedef struct display_list {
+	struct draw_command *commands;
+	Uint32 numCommands;
+	Uint32 capCommands;
+	char *text;
+	Uint32 lenText;
+	Uint32 capText;
+	/* complete and can be replayed */
+	bool valid;
+	/* dropped while recording */
+	bool dirty;
+} DisplayList;
+
+/* primitives are queued until the color changes or this is called,
+ * which has to happen before anything uses the renderer directly */
+int renderer_Flush(void);
+void renderer_GetStats(RendererStats *stats);
+/* moves everything drawn afterwards by dx, dy */
+void renderer_SetOffset(Sint32 dx, Sint32 dy);
+void renderer_GetOffset(Sint32 *dx, Sint32 *dy);
+int renderer_DrawTexture(Texture *texture, const Rect *rect);
+/* renderer calls are appended to list while they are executed, until
+ * renderer_EndRecord(); replaying starts from the current color and
+ * font just like the calls did */
+void renderer_BeginRecord(DisplayList *list);
+void renderer_EndRecord(void);
+int renderer_Replay(const DisplayList *list);
+/* makes the list record again, also while it is recording */
+void renderer_DropList(DisplayList *list);
+void renderer_FreeList(DisplayList *list);
+
 struct font {
 	Font *font;
 	struct word {
 		char *data;
+		Uint32 length;
+		Uint32 hash;
 		Sint32 width, height;
 		SDL_Texture *texture;
+		/* used since the clock hand last passed it */
+		bool referenced;
 	} *cachedWords;
 	Uint32 numCachedWords;
+	Uint32 capCachedWords;
+	/* open addressing table of cachedWords indices + 1, 0 is empty */
+	Uint32 *wordIndex;
+	Uint32 capWordIndex;
+	/* texture and string bytes of the cached words */
+	Size wordBytes;
+	/* next word the eviction looks at */
+	Uint32 clockHand;
+	/* glyphs for TEXT_BACKEND_ATLAS, the surface is the copy of the
+	 * texture that survives growing it */
+	struct atlas {
+		SDL_Surface *surface;
+		SDL_Texture *texture;
+		/* shelf packing, the next glyph goes to x in the row at y */
+		Sint32 x, y, rowHeight;
+		struct glyph {
+			Uint32 ch;
+			Sint32 advance;
+			SDL_Rect rect;
+		} *glyphs;
+		Uint32 numGlyphs;
+		Uint32 capGlyphs;
+		/* like wordIndex */
+		Uint32 *index;
+		Uint32 capIndex;
+	} atlas;
 };
 
+/* one cached texture per word drawn with a copy each (the default), or
+ * glyphs packed into a texture per font and drawn with one geometry
+ * call per renderer_DrawText(), which has no kerning between glyphs */
+#define TEXT_BACKEND_WORDS 0
+#define TEXT_BACKEND_ATLAS 1
+
 Font *renderer_CreateFont(const char *name, int size, Uint32 *pIndex);
 Font *renderer_GetFont(Uint32 index);
 int renderer_SelectFont(Uint32 index);
 int renderer_SetFont(Font *font);
 void renderer_SetTabMultiplier(float multp);
+void renderer_SetTextBackend(Uint32 backend);
+/* every font caches at most maxWords words taking maxBytes of texture
+ * and string memory, the least recently used ones are evicted */
+void renderer_SetWordCacheLimits(Size maxBytes, Uint32 maxWords);
 int renderer_DrawText(const char *text, Uint32 length,
 		Rect *rect);
 int renderer_GetTextExtent(const char *text, Uint32 length,
@@ -109,39 +275,140 @@ bool rect_Intersect(const Rect *r1, const Rect *r2, Rect *rect);
 int rect_Subtract(const Rect *r1, const Rect *r2, Rect *rects);
 bool rect_Contains(const Rect *r, const Point *p);
 
+/* rects as a structure of arrays for the batch kernels, which pick an
+ * AVX2, SSE2 or scalar version at runtime */
+typedef struct rect_array {
+	Sint32 *x, *y, *w, *h;
+	Uint32 numRects;
+} RectArray;
+
+/* sets bit i of the mask (32 per word) if rect overlaps rect i
+ * and returns the number of set bits */
+Uint32 rect_OverlapMask(const Rect *rect, const RectArray *arr, Uint32 *mask);
+/* out may be the same as in and needs room for all rects,
+ * empty intersections get a size of 0; returns the non-empty ones */
+Uint32 rect_IntersectMany(const Rect *rect, const RectArray *in,
+		RectArray *out);
+bool rect_BoundsOf(const RectArray *arr, Rect *bounds);
+
+/* the kernels rect_SetKernels() can force, automatic picks the best the
+ * CPU has */
+#define RECT_KERNELS_AUTO 0
+#define RECT_KERNELS_SCALAR 1
+#define RECT_KERNELS_SSE2 2
+#define RECT_KERNELS_AVX2 3
+
+/* fails when the CPU (or the build) does not have them */
+int rect_SetKernels(Uint32 which);
+
+typedef struct union_stats {
+	Uint64 numAllocs;
+	Uint64 numReallocs;
+	Uint64 numFrees;
+	/* registry lookups and the slots (or chunks) they looked at */
+	Uint64 numLookups;
+	Uint64 numProbes;
+	Size peakAllocated;
+	/* only set by union_GetStats() */
+	Uint32 numLive;
+	Size allocated;
+	float averageScan;
+} UnionStats;
+
 typedef struct mem_union {
+	/* pointers are kept in allocation order (a stack), freed pointers
+	 * leave a hole (sys is NULL) that is compacted later */
 	struct mem_ptr {
 		void *sys;
 		Size size;
 		Uint64 flags;
 	} *pointers;
 	Uint32 numPointers;
+	Uint32 capPointers;
+	Uint32 numHoles;
+	/* outstanding union_Mark() numbers, pointers are not renumbered
+	 * while there are any */
+	Uint32 numMarks;
+	/* open addressing hash table keyed on the sys pointer,
+	 * a slot is 0 (empty), UINT32_MAX (deleted) or index + 1 */
+	Uint32 *index;
+	Uint32 capIndex;
+	Uint32 numIndexUsed;
+	/* arena mode: allocations are carved out of chunks of at least
+	 * chunkSize bytes, chunkSize is 0 for a regular union */
+	struct mem_chunk *chunks;
+	Size chunkSize;
+	/* arena mode: the lowest number of a pointer union_Realloc() moved
+	 * to the top and the highest number of such a copy, 0 for none */
+	Uint32 movedFrom;
+	Uint32 movedTo;
 	Size limit;
 	Size allocated;
+	UnionStats stats;
 } Union;
 
 Union *union_Default(void);
+/* scratch memory that is valid until the end of the current frame */
+Union *union_Frame(void);
 void union_Init(Union *uni, Size limit);
+void union_InitArena(Union *uni, Size chunkSize, Size limit);
 void *union_Alloc(Union *uni, Size sz);
 void *union_Allocf(Union *uni, Size sz, Uint64 flags);
 void *union_Realloc(Union *uni, void *ptr, Size sz);
 void *union_Mask(Union *uni, Uint64 flags, const void *ptr);
+/* the bookkeeping entry of a pointer (regular mode only), it is
+ * invalidated by the next allocation or free */
+struct mem_ptr *union_Find(Union *uni, const void *ptr);
 bool union_HasPointer(Union *uni, void *ptr);
 void union_FreeAll(Union *uni);
+/* frees all pointers but keeps the memory used for bookkeeping */
+void union_Reset(Union *uni);
 int union_Free(Union *uni, void *ptr);
+/* the current number of pointers for a later union_Trim(), the numbers
+ * below it stay valid until the mark is given back with union_Unmark() */
+Uint32 union_Mark(Union *uni);
+void union_Unmark(Union *uni);
+/* frees every pointer allocated after the first numPointers, in arena
+ * mode union_Realloc() moves a pointer that is not the last one to the
+ * top so a pointer below the mark must not be grown before the trim,
+ * such a trim is refused */
 void union_Trim(Union *uni, Uint32 numPointers);
-
+void union_GetStats(const Union *uni, UnionStats *stats);
+
+/* coalesce bands after every operation */
+#define REGION_OPTIMIZE 0x1
+/* rects stored inside the region before spilling to the union */
+#define REGION_INLINE 4
+
+/* the rects are sorted into bands: rects of a band share y and h and
+ * are sorted by x without touching, bands are sorted by y and do not
+ * overlap; all operations replace the contents of the first argument
+ * and keep this form
+ *
+ * regions that would need too many rects switch to a bitmap instead
+ * (bits is not NULL, there are no rects), region_ToRects() switches back
+ */
 typedef struct region {
 	Union *uni;
+	Uint32 flags;
 	Rect *rects;
 	Uint32 numRects;
 	Rect bounds;
+	/* one bit per pixel, 64 pixel words, rows of frame.w / 64 words;
+	 * frame.x and frame.w are multiples of 64 */
+	Uint64 *bits;
+	Rect frame;
+	Rect inlineRects[REGION_INLINE];
 } Region;
 
+/* for regions on the stack or inside other structures, the memory is
+ * released with region_SetEmpty(); such a region must not be copied */
+void region_Init(Region *reg, Union *uni);
 Region *region_Create(void);
 Region *region_Create_u(Union *uni);
 Region *region_SetEmpty(Region *region);
-Region *region_Invert(Region *reg, Region *reg1);
+/* the parts of the bounds of reg1 that are not in reg1 */
+Region *region_Invert(Region *reg, const Region *reg1);
 Region *region_Rect(const Rect *rect);
 Region *region_Rect_u(const Rect *rect, Union *uni);
 Region *region_SetRect(Region *region, const Rect *rect);
@@ -149,7 +416,18 @@ Region *region_AddRect(Region *reg, const Rect *rect);
 Region *region_Intersect(Region *reg, const Region *reg1, const Region *reg2);
 Region *region_Add(Region *reg, const Region *reg1, const Region *reg2);
 Region *region_Subtract(Region *reg, const Region *reg1, const Region *reg2);
+Region *region_Xor(Region *reg, const Region *reg1, const Region *reg2);
+/* brings any list of rects into the banded form and merges vertically
+ * adjacent bands with the same x-spans */
+Region *region_Optimize(Region *reg);
+Region *region_ToRects(Region *reg);
 Region *region_MoveBy(Region *reg, Sint32 dx, Sint32 dy);
+/* results with at least minRects rects become bitmaps when the bitmap
+ * takes at most wordsPerRect 64 pixel words per rect, 0 keeps every
+ * region in rects */
+void region_SetBitmapLimits(Uint32 minRects, Uint32 wordsPerRect);
+bool region_ContainsPoint(const Region *reg, const Point *p);
+bool region_IntersectsRect(const Region *reg, const Rect *rect);
 void region_Delete(Region *reg);
 
 typedef enum {
@@ -458,6 +736,7 @@ typedef struct property_wrapper {
 	char label[MAX_WORD];
 	RawProperty *properties;
 	Uint32 numProperties;
+	Uint32 capProperties;
 } RawWrapper;
 
 typedef struct property {
@@ -487,12 +766,34 @@ int function_Execute(Function *func, Instruction *args, Uint32 numArgs,
 Label *environment_FindLabel(const char *name);
 Label *environment_AddLabel(const char *name);
 int environment_Digest(RawWrapper *wrappers, Uint32 numWrappers);
+/* runs the garbage collector for at most budget microseconds,
+ * a budget of 0 runs a full collection; must not be called
+ * while instructions are executing */
+void environment_GC(Uint32 budget);
+
+/* paint by replaying what the last paint drew until the view is
+ * invalidated, set for views whose label has "record = bool true" */
+#define VIEW_FLAG_RECORD 0x1
+/* render the view and its children into a texture of its rect and
+ * paint by copying it until something in it is invalidated, set for
+ * views whose label has "cached = bool true" */
+#define VIEW_FLAG_CACHED 0x2
 
 typedef struct view {
 	Label *label;
 	Union *uni;
 	Uint64 flags;
+	/* last garbage collection cycle that scanned the values */
+	Uint32 gcCycle;
+	/* performance counter value of the next EVENT_TIMER, 0 for none */
+	Uint64 timer;
+	DisplayList list;
+	/* see VIEW_FLAG_CACHED, the texture may be evicted at any time */
+	Texture *cache;
+	bool cacheValid;
+	Uint64 cacheUsed;
 	Rect rect;
+	/* optional shape relative to the top left of rect */
 	Region *region;
 	Value *values;
 	struct view *prev, *next;
@@ -506,5 +807,19 @@ int view_Send(View *view, event_t type, EventInfo *info);
 Value *view_GetProperty(View *view, type_t type, const char *name);
 bool view_GetBoolProperty(View *view, const char *name);
 int view_GetColorProperty(View *view, const char *name, rgb_t *rgb);
+/* tests against the region of the view if it has one */
+bool view_ContainsPoint(View *view, const Point *p);
+/* views without a size may draw anywhere and invalidate the window */
+void view_Invalidate(View *view);
+/* rect is relative to the top left of the view */
+void view_InvalidateRect(View *view, const Rect *rect);
+/* for changes any view may depend on */
+void view_InvalidateAll(void);
+/* releases the texture of a view with VIEW_FLAG_CACHED */
+void gui_FreeCache(View *view);
+/* sends EVENT_TIMER once after ms milliseconds, a timer can be set
+ * again from the event for animations */
+void view_SetTimer(View *view, Uint32 ms);
+void view_KillTimer(View *view);
 int view_SetParent(View *view, View *parent);
 void view_Delete(View *view);
@@ -1,6 +1,7 @@
 #include "gui.h"
 
 #define PARSER_BUFFER 1024
+#define PARSER_ARENA 4096
 
 struct parser {
 	Union uni;
@@ -1998,14 +1999,21 @@ static int wrapper_AddProperty(struct parser *parser, RawWrapper *wrapper,
 		const RawProperty *property)
 {
 	RawProperty *newProperties;
-
-	newProperties = union_Realloc(&parser->uni, wrapper->properties,
-			sizeof(*wrapper->properties) *
-			(wrapper->numProperties + 1));
-	if (newProperties == NULL) {
-		return parser_Error(parser, "memory");
+	Uint32 newCap;
+
+	/* growing one by one would copy the array each time since only the
+	 * last allocation of the arena grows in place */
+	if (wrapper->numProperties == wrapper->capProperties) {
+		newCap = wrapper->capProperties * 2 + 4;
+		newProperties = union_Realloc(&parser->uni,
+				wrapper->properties,
+				sizeof(*wrapper->properties) * newCap);
+		if (newProperties == NULL) {
+			return parser_Error(parser, "memory");
+		}
+		wrapper->properties = newProperties;
+		wrapper->capProperties = newCap;
 	}
-	wrapper->properties = newProperties;
 	wrapper->properties[wrapper->numProperties++] = *property;
 	return 0;
 }
@@ -2031,7 +2039,7 @@ int prop_ParseString(const char *str, Union *uni, RawWrapper **pWrappers,
 	Uint32 numPtrs;
 	struct parser parser;
 	RawWrapper *wrappers, *newWrappers;
-	Uint32 numWrappers, curWrapper;
+	Uint32 numWrappers, capWrappers, curWrapper;
 
 	/* this is for convenience:
 	 * all parser functions allocate memory using the default union
@@ -2040,18 +2048,20 @@ int prop_ParseString(const char *str, Union *uni, RawWrapper **pWrappers,
 	 * of all the pointers we allocate
 	 */
 	defUni = union_Default();
-	numPtrs = defUni->numPointers;
+	numPtrs = union_Mark(defUni);
 
 	memset(&parser, 0, sizeof(parser));
 
-	union_Init(&parser.uni, SIZE_MAX);
+	union_InitArena(&parser.uni, PARSER_ARENA, SIZE_MAX);
 
 	wrappers = union_Alloc(&parser.uni, sizeof(*wrappers));
 	if (wrappers == NULL) {
+		union_Unmark(defUni);
 		return -1;
 	}
 	curWrapper = 0;
 	numWrappers = 1;
+	capWrappers = 1;
 	memset(wrappers, 0, sizeof(*wrappers));
 
 	parser.source = str;
@@ -2090,16 +2100,21 @@ int prop_ParseString(const char *str, Union *uni, RawWrapper **pWrappers,
 				continue;
 			}
 
-			newWrappers = union_Realloc(&parser.uni, wrappers,
-					sizeof(*wrappers) * (numWrappers + 1));
-			if (newWrappers == NULL) {
-				parser_Error(&parser, "memory");
-				goto fail;
+			if (numWrappers == capWrappers) {
+				capWrappers = capWrappers * 2 + 4;
+				newWrappers = union_Realloc(&parser.uni,
+						wrappers, sizeof(*wrappers) *
+						capWrappers);
+				if (newWrappers == NULL) {
+					parser_Error(&parser, "memory");
+					goto fail;
+				}
+				wrappers = newWrappers;
 			}
-			wrappers = newWrappers;
 			strcpy(wrappers[numWrappers].label, parser.word);
 			wrappers[numWrappers].properties = NULL;
 			wrappers[numWrappers].numProperties = 0;
+			wrappers[numWrappers].capProperties = 0;
 			curWrapper = numWrappers;
 			numWrappers++;
 		} else if (parser.c == '=') {
@@ -2118,6 +2133,7 @@ int prop_ParseString(const char *str, Union *uni, RawWrapper **pWrappers,
 			continue;
 		}
 	}
+	union_Unmark(defUni);
 	*uni = parser.uni;
 	*pWrappers = wrappers;
 	*pNumWrappers = numWrappers;
@@ -2126,6 +2142,7 @@ int prop_ParseString(const char *str, Union *uni, RawWrapper **pWrappers,
 fail:
 	union_FreeAll(&parser.uni);
 	union_Trim(defUni, numPtrs);
+	union_Unmark(defUni);
 	fprintf(stderr, "parser error at line %ld\n> ", parser.line + 1);
 	if (parser.column > 0) {
 		for (Uint32 i = 0; i < parser.column - 1; i++) {
@@ -2154,7 +2171,7 @@ int prop_ParseFile(FILE *file, Union *uni, RawWrapper **pWrappers,
 	Uint32 numPtrs;
 	struct parser parser;
 	RawWrapper *wrappers, *newWrappers;
-	Uint32 numWrappers, curWrapper;
+	Uint32 numWrappers, capWrappers, curWrapper;
 
 	/* this is for convenience:
 	 * all parser functions allocate memory using the default union
@@ -2163,18 +2180,20 @@ int prop_ParseFile(FILE *file, Union *uni, RawWrapper **pWrappers,
 	 * of all the pointers we allocate
 	 */
 	defUni = union_Default();
-	numPtrs = defUni->numPointers;
+	numPtrs = union_Mark(defUni);
 
 	memset(&parser, 0, sizeof(parser));
 
-	union_Init(&parser.uni, SIZE_MAX);
+	union_InitArena(&parser.uni, PARSER_ARENA, SIZE_MAX);
 
 	wrappers = union_Alloc(&parser.uni, sizeof(*wrappers));
 	if (wrappers == NULL) {
+		union_Unmark(defUni);
 		return -1;
 	}
 	curWrapper = 0;
 	numWrappers = 1;
+	capWrappers = 1;
 	memset(wrappers, 0, sizeof(*wrappers));
 
 	/* we buffer ourselves */
@@ -2222,16 +2241,21 @@ int prop_ParseFile(FILE *file, Union *uni, RawWrapper **pWrappers,
 				continue;
 			}
 
-			newWrappers = union_Realloc(&parser.uni, wrappers,
-					sizeof(*wrappers) * (numWrappers + 1));
-			if (newWrappers == NULL) {
-				parser_Error(&parser, "memory");
-				goto fail;
+			if (numWrappers == capWrappers) {
+				capWrappers = capWrappers * 2 + 4;
+				newWrappers = union_Realloc(&parser.uni,
+						wrappers, sizeof(*wrappers) *
+						capWrappers);
+				if (newWrappers == NULL) {
+					parser_Error(&parser, "memory");
+					goto fail;
+				}
+				wrappers = newWrappers;
 			}
-			wrappers = newWrappers;
 			strcpy(wrappers[numWrappers].label, parser.word);
 			wrappers[numWrappers].properties = NULL;
 			wrappers[numWrappers].numProperties = 0;
+			wrappers[numWrappers].capProperties = 0;
 			curWrapper = numWrappers;
 			numWrappers++;
 		} else if (parser.c == '=') {
@@ -2253,6 +2277,7 @@ int prop_ParseFile(FILE *file, Union *uni, RawWrapper **pWrappers,
 			goto fail;
 		}
 	}
+	union_Unmark(defUni);
 	*uni = parser.uni;
 	*pWrappers = wrappers;
 	*pNumWrappers = numWrappers;
@@ -2261,6 +2286,7 @@ int prop_ParseFile(FILE *file, Union *uni, RawWrapper **pWrappers,
 fail:
 	union_FreeAll(&parser.uni);
 	union_Trim(defUni, numPtrs);
+	union_Unmark(defUni);
 	fprintf(stderr, "parser error at line %ld\n> ", parser.line + 1);
 	const struct last_action action = parser.lastAction;
 	Uint32 p = action.sol;
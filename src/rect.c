@@ -68,3 +68,400 @@ bool rect_Contains(const Rect *r, const Point *p)
 	return p->x >= r->x && p->y >= r->y &&
 		p->x < r->x + r->w && p->y < r->y + r->h;
 }
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RECT_X86
+#endif
+
+static struct rect_kernels {
+	Uint32 (*overlapMask)(const Rect *rect, const RectArray *arr,
+			Uint32 *mask);
+	Uint32 (*intersectMany)(const Rect *rect, const RectArray *in,
+			RectArray *out);
+	void (*boundsOf)(const RectArray *arr, Sint32 *box);
+} kernels;
+
+/* the scalar versions also finish the tail the vector versions leave,
+ * from is the first index that is left */
+static Uint32 OverlapMaskFrom(const Rect *rect, const RectArray *arr,
+		Uint32 *mask, Uint32 from)
+{
+	const Sint32 rx2 = rect->x + rect->w;
+	const Sint32 ry2 = rect->y + rect->h;
+	Uint32 count = 0;
+
+	for (Uint32 i = from; i < arr->numRects; i++) {
+		if (arr->w[i] > 0 && arr->h[i] > 0 &&
+				arr->x[i] < rx2 && arr->x[i] + arr->w[i] > rect->x &&
+				arr->y[i] < ry2 && arr->y[i] + arr->h[i] > rect->y) {
+			mask[i / 32] |= (Uint32) 1 << (i % 32);
+			count++;
+		}
+	}
+	return count;
+}
+
+static Uint32 IntersectManyFrom(const Rect *rect, const RectArray *in,
+		RectArray *out, Uint32 from)
+{
+	const Sint32 rx2 = rect->x + rect->w;
+	const Sint32 ry2 = rect->y + rect->h;
+	Uint32 count = 0;
+
+	for (Uint32 i = from; i < in->numRects; i++) {
+		const Sint32 x1 = MAX(in->x[i], rect->x);
+		const Sint32 y1 = MAX(in->y[i], rect->y);
+		const Sint32 x2 = MIN(in->x[i] + in->w[i], rx2);
+		const Sint32 y2 = MIN(in->y[i] + in->h[i], ry2);
+
+		out->x[i] = x1;
+		out->y[i] = y1;
+		if (x2 > x1 && y2 > y1) {
+			out->w[i] = x2 - x1;
+			out->h[i] = y2 - y1;
+			count++;
+		} else {
+			out->w[i] = 0;
+			out->h[i] = 0;
+		}
+	}
+	return count;
+}
+
+static void BoundsOfFrom(const RectArray *arr, Sint32 *box, Uint32 from)
+{
+	for (Uint32 i = from; i < arr->numRects; i++) {
+		box[0] = MIN(box[0], arr->x[i]);
+		box[1] = MIN(box[1], arr->y[i]);
+		box[2] = MAX(box[2], arr->x[i] + arr->w[i]);
+		box[3] = MAX(box[3], arr->y[i] + arr->h[i]);
+	}
+}
+
+static Uint32 OverlapMaskScalar(const Rect *rect, const RectArray *arr,
+		Uint32 *mask)
+{
+	return OverlapMaskFrom(rect, arr, mask, 0);
+}
+
+static Uint32 IntersectManyScalar(const Rect *rect, const RectArray *in,
+		RectArray *out)
+{
+	return IntersectManyFrom(rect, in, out, 0);
+}
+
+static void BoundsOfScalar(const RectArray *arr, Sint32 *box)
+{
+	BoundsOfFrom(arr, box, 0);
+}
+
+#ifdef RECT_X86
+/* SSE2 has no signed 32-bit min and max */
+__attribute__((target("sse2")))
+static inline __m128i Max128(__m128i a, __m128i b)
+{
+	const __m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i Min128(__m128i a, __m128i b)
+{
+	const __m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+__attribute__((target("sse2")))
+static Uint32 OverlapMaskSSE2(const Rect *rect, const RectArray *arr,
+		Uint32 *mask)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rx = _mm_set1_epi32(rect->x);
+	const __m128i ry = _mm_set1_epi32(rect->y);
+	const __m128i rx2 = _mm_set1_epi32(rect->x + rect->w);
+	const __m128i ry2 = _mm_set1_epi32(rect->y + rect->h);
+	Uint32 count = 0;
+	Uint32 i;
+
+	for (i = 0; i + 4 <= arr->numRects; i += 4) {
+		const __m128i x = _mm_loadu_si128((const __m128i*) &arr->x[i]);
+		const __m128i y = _mm_loadu_si128((const __m128i*) &arr->y[i]);
+		const __m128i w = _mm_loadu_si128((const __m128i*) &arr->w[i]);
+		const __m128i h = _mm_loadu_si128((const __m128i*) &arr->h[i]);
+		__m128i m;
+
+		m = _mm_and_si128(_mm_cmpgt_epi32(w, zero),
+				_mm_cmpgt_epi32(h, zero));
+		m = _mm_and_si128(m, _mm_cmpgt_epi32(rx2, x));
+		m = _mm_and_si128(m, _mm_cmpgt_epi32(_mm_add_epi32(x, w), rx));
+		m = _mm_and_si128(m, _mm_cmpgt_epi32(ry2, y));
+		m = _mm_and_si128(m, _mm_cmpgt_epi32(_mm_add_epi32(y, h), ry));
+		const Uint32 bits = _mm_movemask_ps(_mm_castsi128_ps(m));
+		mask[i / 32] |= bits << (i % 32);
+		count += __builtin_popcount(bits);
+	}
+	return count + OverlapMaskFrom(rect, arr, mask, i);
+}
+
+__attribute__((target("sse2")))
+static Uint32 IntersectManySSE2(const Rect *rect, const RectArray *in,
+		RectArray *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rx = _mm_set1_epi32(rect->x);
+	const __m128i ry = _mm_set1_epi32(rect->y);
+	const __m128i rx2 = _mm_set1_epi32(rect->x + rect->w);
+	const __m128i ry2 = _mm_set1_epi32(rect->y + rect->h);
+	Uint32 count = 0;
+	Uint32 i;
+
+	for (i = 0; i + 4 <= in->numRects; i += 4) {
+		const __m128i x = _mm_loadu_si128((const __m128i*) &in->x[i]);
+		const __m128i y = _mm_loadu_si128((const __m128i*) &in->y[i]);
+		const __m128i w = _mm_loadu_si128((const __m128i*) &in->w[i]);
+		const __m128i h = _mm_loadu_si128((const __m128i*) &in->h[i]);
+		const __m128i x1 = Max128(x, rx);
+		const __m128i y1 = Max128(y, ry);
+		__m128i nw = _mm_sub_epi32(Min128(_mm_add_epi32(x, w), rx2), x1);
+		__m128i nh = _mm_sub_epi32(Min128(_mm_add_epi32(y, h), ry2), y1);
+		const __m128i m = _mm_and_si128(_mm_cmpgt_epi32(nw, zero),
+				_mm_cmpgt_epi32(nh, zero));
+
+		nw = _mm_and_si128(nw, m);
+		nh = _mm_and_si128(nh, m);
+		_mm_storeu_si128((__m128i*) &out->x[i], x1);
+		_mm_storeu_si128((__m128i*) &out->y[i], y1);
+		_mm_storeu_si128((__m128i*) &out->w[i], nw);
+		_mm_storeu_si128((__m128i*) &out->h[i], nh);
+		count += __builtin_popcount(
+				_mm_movemask_ps(_mm_castsi128_ps(m)));
+	}
+	return count + IntersectManyFrom(rect, in, out, i);
+}
+
+__attribute__((target("sse2")))
+static void BoundsOfSSE2(const RectArray *arr, Sint32 *box)
+{
+	__m128i x1 = _mm_set1_epi32(box[0]);
+	__m128i y1 = _mm_set1_epi32(box[1]);
+	__m128i x2 = _mm_set1_epi32(box[2]);
+	__m128i y2 = _mm_set1_epi32(box[3]);
+	Sint32 v[4][4];
+	Uint32 i;
+
+	for (i = 0; i + 4 <= arr->numRects; i += 4) {
+		const __m128i x = _mm_loadu_si128((const __m128i*) &arr->x[i]);
+		const __m128i y = _mm_loadu_si128((const __m128i*) &arr->y[i]);
+		const __m128i w = _mm_loadu_si128((const __m128i*) &arr->w[i]);
+		const __m128i h = _mm_loadu_si128((const __m128i*) &arr->h[i]);
+
+		x1 = Min128(x1, x);
+		y1 = Min128(y1, y);
+		x2 = Max128(x2, _mm_add_epi32(x, w));
+		y2 = Max128(y2, _mm_add_epi32(y, h));
+	}
+	_mm_storeu_si128((__m128i*) v[0], x1);
+	_mm_storeu_si128((__m128i*) v[1], y1);
+	_mm_storeu_si128((__m128i*) v[2], x2);
+	_mm_storeu_si128((__m128i*) v[3], y2);
+	for (Uint32 l = 0; l < 4; l++) {
+		box[0] = MIN(box[0], v[0][l]);
+		box[1] = MIN(box[1], v[1][l]);
+		box[2] = MAX(box[2], v[2][l]);
+		box[3] = MAX(box[3], v[3][l]);
+	}
+	BoundsOfFrom(arr, box, i);
+}
+
+__attribute__((target("avx2")))
+static Uint32 OverlapMaskAVX2(const Rect *rect, const RectArray *arr,
+		Uint32 *mask)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i rx = _mm256_set1_epi32(rect->x);
+	const __m256i ry = _mm256_set1_epi32(rect->y);
+	const __m256i rx2 = _mm256_set1_epi32(rect->x + rect->w);
+	const __m256i ry2 = _mm256_set1_epi32(rect->y + rect->h);
+	Uint32 count = 0;
+	Uint32 i;
+
+	for (i = 0; i + 8 <= arr->numRects; i += 8) {
+		const __m256i x = _mm256_loadu_si256((const __m256i*) &arr->x[i]);
+		const __m256i y = _mm256_loadu_si256((const __m256i*) &arr->y[i]);
+		const __m256i w = _mm256_loadu_si256((const __m256i*) &arr->w[i]);
+		const __m256i h = _mm256_loadu_si256((const __m256i*) &arr->h[i]);
+		__m256i m;
+
+		m = _mm256_and_si256(_mm256_cmpgt_epi32(w, zero),
+				_mm256_cmpgt_epi32(h, zero));
+		m = _mm256_and_si256(m, _mm256_cmpgt_epi32(rx2, x));
+		m = _mm256_and_si256(m,
+				_mm256_cmpgt_epi32(_mm256_add_epi32(x, w), rx));
+		m = _mm256_and_si256(m, _mm256_cmpgt_epi32(ry2, y));
+		m = _mm256_and_si256(m,
+				_mm256_cmpgt_epi32(_mm256_add_epi32(y, h), ry));
+		const Uint32 bits = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+		mask[i / 32] |= bits << (i % 32);
+		count += __builtin_popcount(bits);
+	}
+	return count + OverlapMaskFrom(rect, arr, mask, i);
+}
+
+__attribute__((target("avx2")))
+static Uint32 IntersectManyAVX2(const Rect *rect, const RectArray *in,
+		RectArray *out)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i rx = _mm256_set1_epi32(rect->x);
+	const __m256i ry = _mm256_set1_epi32(rect->y);
+	const __m256i rx2 = _mm256_set1_epi32(rect->x + rect->w);
+	const __m256i ry2 = _mm256_set1_epi32(rect->y + rect->h);
+	Uint32 count = 0;
+	Uint32 i;
+
+	for (i = 0; i + 8 <= in->numRects; i += 8) {
+		const __m256i x = _mm256_loadu_si256((const __m256i*) &in->x[i]);
+		const __m256i y = _mm256_loadu_si256((const __m256i*) &in->y[i]);
+		const __m256i w = _mm256_loadu_si256((const __m256i*) &in->w[i]);
+		const __m256i h = _mm256_loadu_si256((const __m256i*) &in->h[i]);
+		const __m256i x1 = _mm256_max_epi32(x, rx);
+		const __m256i y1 = _mm256_max_epi32(y, ry);
+		__m256i nw = _mm256_sub_epi32(_mm256_min_epi32(
+					_mm256_add_epi32(x, w), rx2), x1);
+		__m256i nh = _mm256_sub_epi32(_mm256_min_epi32(
+					_mm256_add_epi32(y, h), ry2), y1);
+		const __m256i m = _mm256_and_si256(
+				_mm256_cmpgt_epi32(nw, zero),
+				_mm256_cmpgt_epi32(nh, zero));
+
+		nw = _mm256_and_si256(nw, m);
+		nh = _mm256_and_si256(nh, m);
+		_mm256_storeu_si256((__m256i*) &out->x[i], x1);
+		_mm256_storeu_si256((__m256i*) &out->y[i], y1);
+		_mm256_storeu_si256((__m256i*) &out->w[i], nw);
+		_mm256_storeu_si256((__m256i*) &out->h[i], nh);
+		count += __builtin_popcount(
+				_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+	}
+	return count + IntersectManyFrom(rect, in, out, i);
+}
+
+__attribute__((target("avx2")))
+static void BoundsOfAVX2(const RectArray *arr, Sint32 *box)
+{
+	__m256i x1 = _mm256_set1_epi32(box[0]);
+	__m256i y1 = _mm256_set1_epi32(box[1]);
+	__m256i x2 = _mm256_set1_epi32(box[2]);
+	__m256i y2 = _mm256_set1_epi32(box[3]);
+	Sint32 v[4][8];
+	Uint32 i;
+
+	for (i = 0; i + 8 <= arr->numRects; i += 8) {
+		const __m256i x = _mm256_loadu_si256((const __m256i*) &arr->x[i]);
+		const __m256i y = _mm256_loadu_si256((const __m256i*) &arr->y[i]);
+		const __m256i w = _mm256_loadu_si256((const __m256i*) &arr->w[i]);
+		const __m256i h = _mm256_loadu_si256((const __m256i*) &arr->h[i]);
+
+		x1 = _mm256_min_epi32(x1, x);
+		y1 = _mm256_min_epi32(y1, y);
+		x2 = _mm256_max_epi32(x2, _mm256_add_epi32(x, w));
+		y2 = _mm256_max_epi32(y2, _mm256_add_epi32(y, h));
+	}
+	_mm256_storeu_si256((__m256i*) v[0], x1);
+	_mm256_storeu_si256((__m256i*) v[1], y1);
+	_mm256_storeu_si256((__m256i*) v[2], x2);
+	_mm256_storeu_si256((__m256i*) v[3], y2);
+	for (Uint32 l = 0; l < 8; l++) {
+		box[0] = MIN(box[0], v[0][l]);
+		box[1] = MIN(box[1], v[1][l]);
+		box[2] = MAX(box[2], v[2][l]);
+		box[3] = MAX(box[3], v[3][l]);
+	}
+	BoundsOfFrom(arr, box, i);
+}
+#endif
+
+int rect_SetKernels(Uint32 which)
+{
+	switch (which) {
+	case RECT_KERNELS_AUTO:
+#ifdef RECT_X86
+		if (SDL_HasAVX2()) {
+			return rect_SetKernels(RECT_KERNELS_AVX2);
+		}
+		if (SDL_HasSSE2()) {
+			return rect_SetKernels(RECT_KERNELS_SSE2);
+		}
+#endif
+		return rect_SetKernels(RECT_KERNELS_SCALAR);
+	case RECT_KERNELS_SCALAR:
+		kernels.overlapMask = OverlapMaskScalar;
+		kernels.intersectMany = IntersectManyScalar;
+		kernels.boundsOf = BoundsOfScalar;
+		return 0;
+#ifdef RECT_X86
+	case RECT_KERNELS_SSE2:
+		if (!SDL_HasSSE2()) {
+			return -1;
+		}
+		kernels.overlapMask = OverlapMaskSSE2;
+		kernels.intersectMany = IntersectManySSE2;
+		kernels.boundsOf = BoundsOfSSE2;
+		return 0;
+	case RECT_KERNELS_AVX2:
+		if (!SDL_HasAVX2()) {
+			return -1;
+		}
+		kernels.overlapMask = OverlapMaskAVX2;
+		kernels.intersectMany = IntersectManyAVX2;
+		kernels.boundsOf = BoundsOfAVX2;
+		return 0;
+#endif
+	}
+	return -1;
+}
+
+static void SelectKernels(void)
+{
+	rect_SetKernels(RECT_KERNELS_AUTO);
+}
+
+Uint32 rect_OverlapMask(const Rect *rect, const RectArray *arr, Uint32 *mask)
+{
+	if (kernels.overlapMask == NULL) {
+		SelectKernels();
+	}
+	memset(mask, 0, sizeof(*mask) * ((arr->numRects + 31) / 32));
+	if (rect->w <= 0 || rect->h <= 0) {
+		return 0;
+	}
+	return kernels.overlapMask(rect, arr, mask);
+}
+
+Uint32 rect_IntersectMany(const Rect *rect, const RectArray *in,
+		RectArray *out)
+{
+	if (kernels.intersectMany == NULL) {
+		SelectKernels();
+	}
+	return kernels.intersectMany(rect, in, out);
+}
+
+bool rect_BoundsOf(const RectArray *arr, Rect *bounds)
+{
+	Sint32 box[4] = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+
+	if (arr->numRects == 0) {
+		return false;
+	}
+	if (kernels.boundsOf == NULL) {
+		SelectKernels();
+	}
+	kernels.boundsOf(arr, box);
+	bounds->x = box[0];
+	bounds->y = box[1];
+	bounds->w = box[2] - box[0];
+	bounds->h = box[3] - box[1];
+	return true;
+}
@@ -1,10 +1,42 @@
 #include "gui.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* a result with at least this many rects becomes a bitmap when it is
+ * dense enough... */
+#define BITMAP_MIN_RECTS 512
+/* ...that is when the bitmap has at most this many 64 pixel words per
+ * rect, region_bench has a rect cost about as much as two words */
+#define BITMAP_WORDS_PER_RECT 2
+/* a bitmap goes back to rects when it can be described with at most
+ * this many */
+#define BITMAP_BACK 256
+
+static Uint32 region_minRects = BITMAP_MIN_RECTS;
+static Uint32 region_wordsPerRect = BITMAP_WORDS_PER_RECT;
+
+static inline bool IsEmpty(const Rect *rect)
+{
+	return rect->w <= 0 || rect->h <= 0;
+}
+
 Region *region_Create(void)
 {
 	return region_Create_u(union_Default());
 }
 
+void region_Init(Region *reg, Union *uni)
+{
+	reg->uni = uni;
+	reg->flags = 0;
+	reg->rects = NULL;
+	reg->numRects = 0;
+	reg->bounds = (Rect) { 0, 0, 0, 0 };
+	reg->bits = NULL;
+}
+
 Region *region_Create_u(Union *uni)
 {
 	Region *reg;
@@ -13,19 +45,48 @@ Region *region_Create_u(Union *uni)
 	if (reg == NULL) {
 		return NULL;
 	}
-	reg->uni = uni;
-	reg->rects = NULL;
-	reg->numRects = 0;
-	reg->bounds = (Rect) { 0, 0, 0, 0 };
+	region_Init(reg, uni);
 	return reg;
 }
 
-Region *region_SetEmpty(Region *reg)
+static void FreeBits(Region *reg)
+{
+	if (reg->bits != NULL) {
+		union_Free(reg->uni, reg->bits);
+		reg->bits = NULL;
+	}
+}
+
+static void FreeRects(Region *reg)
 {
-	if (reg->rects != NULL) {
+	if (reg->rects != NULL && reg->rects != reg->inlineRects) {
 		union_Free(reg->uni, reg->rects);
-		reg->rects = NULL;
 	}
+	reg->rects = NULL;
+}
+
+/* moves the contents of src into an empty dst, keeping the flags of
+ * dst and taking care of inline rects */
+static void MoveRegion(Region *dst, Region *src)
+{
+	if (src->rects == src->inlineRects) {
+		memcpy(dst->inlineRects, src->inlineRects,
+				sizeof(*src->rects) * src->numRects);
+		dst->rects = dst->inlineRects;
+	} else {
+		dst->rects = src->rects;
+	}
+	dst->numRects = src->numRects;
+	dst->bounds = src->bounds;
+	dst->bits = src->bits;
+	dst->frame = src->frame;
+	region_Init(src, src->uni);
+}
+
+Region *region_SetEmpty(Region *reg)
+{
+	FreeBits(reg);
+	FreeRects(reg);
 	reg->numRects = 0;
 	reg->bounds = (Rect) { 0, 0, 0, 0 };
 	return reg;
@@ -44,238 +105,999 @@ Region *region_Rect_u(const Rect *rect, Union *uni)
 	if (reg == NULL) {
 		return NULL;
 	}
-	reg->rects = union_Alloc(uni, sizeof(*reg->rects));
-	if (reg->rects == NULL) {
-		union_Free(uni, reg);
-		return NULL;
+	return region_SetRect(reg, rect);
+}
+
+Region *region_SetRect(Region *reg, const Rect *rect)
+{
+	if (IsEmpty(rect)) {
+		return region_SetEmpty(reg);
 	}
+	FreeBits(reg);
+	FreeRects(reg);
+	reg->rects = reg->inlineRects;
 	reg->rects[0] = *rect;
-	reg->numRects =  1;
+	reg->numRects = 1;
 	reg->bounds = *rect;
 	return reg;
 }
 
-Region *region_SetRect(Region *reg, const Rect *rect)
+/* keep the parts covered by only the first, only the second or both
+ * regions */
+#define OP_LEFT 0x1
+#define OP_RIGHT 0x2
+#define OP_BOTH 0x4
+
+/* results are collected on the stack first and only go to the union
+ * when they outgrow the inline rects of a region */
+struct region_out {
+	Union *uni;
+	Rect *rects;
+	Uint32 numRects;
+	Uint32 capRects;
+	bool failed;
+	Rect small[REGION_INLINE];
+};
+
+static void InitOut(struct region_out *out, Union *uni)
 {
-	Rect *newRects;
+	out->uni = uni;
+	out->rects = out->small;
+	out->numRects = 0;
+	out->capRects = REGION_INLINE;
+	out->failed = false;
+}
 
-	if (rect_IsEmpty(rect)) {
-		return region_SetEmpty(reg);
+static void FreeOut(struct region_out *out)
+{
+	if (out->rects != out->small) {
+		union_Free(out->uni, out->rects);
 	}
+}
 
-	newRects = union_Realloc(reg->uni, reg->rects, sizeof(*reg->rects));
-	if (newRects == NULL) {
-		return NULL;
+/* replaces the contents of reg with the collected rects */
+static void TakeOut(Region *reg, struct region_out *out)
+{
+	FreeBits(reg);
+	FreeRects(reg);
+	if (out->numRects == 0) {
+		FreeOut(out);
+	} else if (out->rects == out->small) {
+		memcpy(reg->inlineRects, out->small,
+				sizeof(*out->small) * out->numRects);
+		reg->rects = reg->inlineRects;
+	} else {
+		reg->rects = out->rects;
 	}
-	reg->rects = newRects;
-	reg->rects[0] = *rect;
-	reg->numRects = 1;
-	reg->bounds = *rect;
-	return reg;
+	reg->numRects = out->numRects;
 }
 
-Region *region_AddRect(Region *reg, const Rect *rect)
+static void PushRect(struct region_out *out, Sint32 x1, Sint32 x2,
+		Sint32 y1, Sint32 y2)
 {
 	Rect *newRects;
+	Uint32 newCap;
 
-	newRects = union_Realloc(reg->uni, reg->rects, sizeof(*reg->rects) *
-			(reg->numRects + 1));
-	if (newRects == NULL) {
-		return NULL;
+	if (out->failed) {
+		return;
+	}
+	if (out->numRects == out->capRects) {
+		newCap = out->capRects * 2 + 8;
+		newRects = union_Realloc(out->uni,
+				out->rects == out->small ? NULL : out->rects,
+				sizeof(*out->rects) * newCap);
+		if (newRects == NULL) {
+			out->failed = true;
+			return;
+		}
+		if (out->rects == out->small) {
+			memcpy(newRects, out->small, sizeof(out->small));
+		}
+		out->rects = newRects;
+		out->capRects = newCap;
 	}
-	reg->rects = newRects;
-	reg->rects[reg->numRects++] = *rect;
+	out->rects[out->numRects++] = (Rect) { x1, y1, x2 - x1, y2 - y1 };
+}
+
+/* end of the band that starts at index i */
+static Uint32 BandEnd(const Region *reg, Uint32 i)
+{
+	const Sint32 y = reg->rects[i].y;
 
-	const Sint32 dx1 = rect->x - reg->bounds.x;
-	const Sint32 dx2 = reg->bounds.x + reg->bounds.w - (rect->x + rect->w);
-	const Sint32 dy1 = rect->y - reg->bounds.y;
-	const Sint32 dy2 = reg->bounds.y + reg->bounds.h - (rect->y + rect->h);
-	if (dx1 < 0) {
-		reg->bounds.x += dx1;
-		reg->bounds.w -= dx1;
+	while (i < reg->numRects && reg->rects[i].y == y) {
+		i++;
 	}
-	if (dx2 < 0) {
-		reg->bounds.w -= dx2;
+	return i;
+}
+
+/* combines the x-spans of two bands, a band that is not in the
+ * current y-interval is passed with n = 0 */
+static void MergeSpans(struct region_out *out, int op,
+		const Rect *a, Uint32 na, const Rect *b, Uint32 nb,
+		Sint32 y1, Sint32 y2)
+{
+	Uint32 i = 0, j = 0;
+	bool in1 = false, in2 = false, inside = false;
+	Sint32 start = 0;
+
+	for (;;) {
+		const Sint32 next1 = i == na ? INT32_MAX :
+			in1 ? a[i].x + a[i].w : a[i].x;
+		const Sint32 next2 = j == nb ? INT32_MAX :
+			in2 ? b[j].x + b[j].w : b[j].x;
+		const Sint32 x = MIN(next1, next2);
+		bool now;
+
+		if (i == na && j == nb) {
+			break;
+		}
+		if (next1 == x) {
+			if (in1) {
+				i++;
+			}
+			in1 = !in1;
+		}
+		if (next2 == x) {
+			if (in2) {
+				j++;
+			}
+			in2 = !in2;
+		}
+		now = in1 && in2 ? (op & OP_BOTH) :
+			in1 ? (op & OP_LEFT) :
+			in2 ? (op & OP_RIGHT) : false;
+		if (now != inside) {
+			if (now) {
+				start = x;
+			} else {
+				PushRect(out, start, x, y1, y2);
+			}
+			inside = now;
+		}
 	}
-	if (dy1 < 0) {
-		reg->bounds.y += dy1;
-		reg->bounds.h -= dy1;
+}
+
+static void ComputeBounds(Region *reg)
+{
+	Sint32 x1, x2;
+
+	if (reg->numRects == 0) {
+		reg->bounds = (Rect) { 0, 0, 0, 0 };
+		return;
 	}
-	if (dy2 < 0) {
-		reg->bounds.h -= dy2;
+	x1 = INT32_MAX;
+	x2 = INT32_MIN;
+	for (Uint32 i = 0; i < reg->numRects; i++) {
+		x1 = MIN(x1, reg->rects[i].x);
+		x2 = MAX(x2, reg->rects[i].x + reg->rects[i].w);
 	}
+	const Rect *const last = &reg->rects[reg->numRects - 1];
+	reg->bounds.x = x1;
+	reg->bounds.y = reg->rects[0].y;
+	reg->bounds.w = x2 - x1;
+	reg->bounds.h = last->y + last->h - reg->bounds.y;
+}
+
+/* wraps a single rect without allocating anything */
+static inline Region RectRegion(const Rect *rect)
+{
+	Region reg;
+
+	reg.uni = NULL;
+	reg.flags = 0;
+	reg.bits = NULL;
+	reg.rects = (Rect*) rect;
+	reg.numRects = IsEmpty(rect) ? 0 : 1;
+	reg.bounds = *rect;
 	return reg;
 }
 
-Region *region_Intersect(Region *reg, const Region *reg1, const Region *reg2)
+/* merges vertically adjacent bands that have the same x-spans */
+static void Coalesce(Region *reg)
 {
-	for (Uint32 i = 0; i < reg1->numRects; i++) {
-		for (Uint32 j = 0; j < reg2->numRects; j++) {
-			Rect res;
+	Uint32 prev = 0, prevEnd = 0, write = 0;
 
-			if (rect_Intersect(&reg1->rects[i], &reg1->rects[j],
-						&res)) {
-				if (region_AddRect(reg, &res) == NULL) {
-					region_Delete(reg);
-					return NULL;
+	for (Uint32 i = 0, end; i < reg->numRects; i = end) {
+		end = BandEnd(reg, i);
+		const Uint32 n = end - i;
+		if (prevEnd - prev == n && reg->rects[prev].y +
+				reg->rects[prev].h == reg->rects[i].y) {
+			Uint32 k;
+
+			for (k = 0; k < n; k++) {
+				if (reg->rects[prev + k].x !=
+						reg->rects[i + k].x ||
+						reg->rects[prev + k].w !=
+						reg->rects[i + k].w) {
+					break;
+				}
+			}
+			if (k == n) {
+				for (k = 0; k < n; k++) {
+					reg->rects[prev + k].h +=
+						reg->rects[i].h;
 				}
+				continue;
 			}
 		}
+		memmove(&reg->rects[write], &reg->rects[i],
+				sizeof(*reg->rects) * n);
+		prev = write;
+		write += n;
+		prevEnd = write;
 	}
-	return reg;
+	reg->numRects = write;
 }
 
-Region *region_Add(Region *reg, const Region *reg1, const Region *reg2)
+static bool IsBanded(const Region *reg)
 {
-	Rect *newRects;
-	Uint32 newSize;
+	for (Uint32 i = 0; i < reg->numRects; i++) {
+		const Rect *const r = &reg->rects[i];
+
+		if (IsEmpty(r)) {
+			return false;
+		}
+		if (i == 0) {
+			continue;
+		}
+		const Rect *const p = &reg->rects[i - 1];
+		if (p->y == r->y) {
+			if (p->h != r->h || p->x + p->w >= r->x) {
+				return false;
+			}
+		} else if (p->y + p->h > r->y) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* a sweep over the bands of both regions, like the X server does it:
+ * the y-axis is cut where any band starts or ends and within each of
+ * these intervals the x-spans are merged; reg may be the same as reg1
+ * or reg2 */
+static Region *RectOp(Region *reg, const Region *reg1, const Region *reg2,
+		int op)
+{
+	struct region_out out;
+	Uint32 b1 = 0, b2 = 0;
+	Uint32 e1 = 0, e2 = 0;
+	Sint32 y = INT32_MIN;
+
+	InitOut(&out, reg->uni);
 
-	newSize = reg1->numRects + reg2->numRects;
-	newRects = union_Realloc(reg->uni, reg->rects,
-			sizeof(*reg->rects) * newSize);
-	if (newRects == NULL) {
+	if (reg1->numRects > 0) {
+		e1 = BandEnd(reg1, 0);
+	}
+	if (reg2->numRects > 0) {
+		e2 = BandEnd(reg2, 0);
+	}
+	while (b1 < reg1->numRects || b2 < reg2->numRects) {
+		const Rect *const r1 = b1 < reg1->numRects ?
+			&reg1->rects[b1] : NULL;
+		const Rect *const r2 = b2 < reg2->numRects ?
+			&reg2->rects[b2] : NULL;
+		const Sint32 top1 = r1 == NULL ? INT32_MAX : MAX(r1->y, y);
+		const Sint32 top2 = r2 == NULL ? INT32_MAX : MAX(r2->y, y);
+		const Sint32 top = MIN(top1, top2);
+		const bool on1 = top1 == top;
+		const bool on2 = top2 == top;
+		Sint32 bot;
+
+		/* the interval ends where an active band ends
+		 * or an inactive one starts */
+		bot = INT32_MAX;
+		if (r1 != NULL) {
+			bot = MIN(bot, on1 ? r1->y + r1->h : top1);
+		}
+		if (r2 != NULL) {
+			bot = MIN(bot, on2 ? r2->y + r2->h : top2);
+		}
+
+		if ((on1 && on2) || (on1 && (op & OP_LEFT)) ||
+				(on2 && (op & OP_RIGHT))) {
+			MergeSpans(&out, op,
+				on1 ? &reg1->rects[b1] : NULL,
+				on1 ? e1 - b1 : 0,
+				on2 ? &reg2->rects[b2] : NULL,
+				on2 ? e2 - b2 : 0,
+				top, bot);
+		}
+
+		y = bot;
+		if (r1 != NULL && r1->y + r1->h <= y) {
+			b1 = e1;
+			if (b1 < reg1->numRects) {
+				e1 = BandEnd(reg1, b1);
+			}
+		}
+		if (r2 != NULL && r2->y + r2->h <= y) {
+			b2 = e2;
+			if (b2 < reg2->numRects) {
+				e2 = BandEnd(reg2, b2);
+			}
+		}
+	}
+
+	if (out.failed) {
+		FreeOut(&out);
 		return NULL;
 	}
-	reg->rects = newRects;
-	reg->numRects = newSize;
-	memcpy(reg->rects, reg1->rects, sizeof(*reg1->rects) * reg1->numRects);
-	memcpy(&reg->rects[reg1->numRects],
-			reg2->rects, sizeof(*reg2->rects) * reg2->numRects);
-	reg->bounds.x = MIN(reg1->bounds.x, reg2->bounds.x);
-	reg->bounds.y = MIN(reg1->bounds.y, reg2->bounds.y);
-	reg->bounds.w = MAX(reg1->bounds.x + reg1->bounds.w,
-			reg2->bounds.x + reg2->bounds.w) - reg->bounds.x;
-	reg->bounds.h = MAX(reg1->bounds.y + reg1->bounds.h,
-			reg2->bounds.y + reg2->bounds.h) - reg->bounds.y;
+	TakeOut(reg, &out);
+	if (reg->flags & REGION_OPTIMIZE) {
+		Coalesce(reg);
+	}
+	ComputeBounds(reg);
 	return reg;
 }
 
-static int CompareRectsX(const void *a, const void *b)
+/* bitmap mode: one bit per pixel in rows of 64 pixel words, the frame
+ * is aligned to multiples of 64 on the x-axis so that the words of two
+ * bitmaps line up without any shifting */
+
+static inline Sint32 AlignDown(Sint32 x)
+{
+	return x & ~63;
+}
+
+static inline Sint32 AlignUp(Sint32 x)
 {
-	const Rect *const r1 = a, *const r2 = b;
-	return r1->x - r2->x;
+	return (x + 63) & ~63;
 }
 
-static int CompareRectsY(const void *a, const void *b)
+static void SetSpan(Uint64 *row, Sint32 x1, Sint32 x2)
 {
-	const Rect *const r1 = a, *const r2 = b;
-	return r1->y - r2->y;
+	const Sint32 w1 = x1 / 64, w2 = (x2 - 1) / 64;
+	const Uint64 m1 = ~(Uint64) 0 << (x1 % 64);
+	const Uint64 m2 = ~(Uint64) 0 >> (63 - (x2 - 1) % 64);
+
+	if (w1 == w2) {
+		row[w1] |= m1 & m2;
+		return;
+	}
+	row[w1] |= m1;
+	for (Sint32 w = w1 + 1; w < w2; w++) {
+		row[w] = ~(Uint64) 0;
+	}
+	row[w2] |= m2;
 }
 
-Region *region_Invert(Region *reg, Region *reg1)
+/* draws any region into a zeroed bitmap with the given frame */
+static void Rasterize(const Region *reg, Uint64 *bits, const Rect *frame)
 {
+	const Uint32 pitch = frame->w / 64;
 	Rect r;
-	Uint32 ys, yi;
-
-	reg->bounds = reg1->bounds;
-
-	/* sorting at the beginning allows for smaller lookup sizes */
-	qsort(reg1->rects, reg1->numRects, sizeof(*reg1->rects), CompareRectsY);
-	ys = 0;
-	yi = 0;
-	r.y = reg1->bounds.y;
-	r.h = 0;
-	for (Sint32 i = 0; i < reg1->bounds.h; i++) {
-		for (; ys < reg1->numRects; ys++) {
-			if (reg1->rects[ys].y + reg1->rects[ys].h > r.y) {
-				break;
-			}
+
+	if (reg->bits != NULL) {
+		if (!rect_Intersect(&reg->frame, frame, &r)) {
+			return;
+		}
+		const Uint32 srcPitch = reg->frame.w / 64;
+		const Uint32 n = r.w / 64;
+		for (Sint32 y = r.y; y < r.y + r.h; y++) {
+			memcpy(&bits[(y - frame->y) * pitch +
+					(r.x - frame->x) / 64],
+				&reg->bits[(y - reg->frame.y) * srcPitch +
+					(r.x - reg->frame.x) / 64],
+				sizeof(*bits) * n);
+		}
+		return;
+	}
+	for (Uint32 i = 0; i < reg->numRects; i++) {
+		if (!rect_Intersect(&reg->rects[i], frame, &r)) {
+			continue;
+		}
+		for (Sint32 y = r.y; y < r.y + r.h; y++) {
+			SetSpan(&bits[(y - frame->y) * pitch],
+					r.x - frame->x, r.x + r.w - frame->x);
 		}
+	}
+}
+
+static void CombineBits(Uint64 *a, const Uint64 *b, Size n, int op)
+{
+	Size i = 0;
+
+#ifdef __SSE2__
+	for (; i + 2 <= n; i += 2) {
+		const __m128i va = _mm_loadu_si128((const __m128i*) &a[i]);
+		const __m128i vb = _mm_loadu_si128((const __m128i*) &b[i]);
+		__m128i v;
 
-		for (yi = ys; yi < reg1->numRects; yi++) {
-			if (reg1->rects[yi].y > r.y + r.h) {
-				break;
+		switch (op) {
+		case OP_BOTH:
+			v = _mm_and_si128(va, vb);
+			break;
+		case OP_LEFT:
+			v = _mm_andnot_si128(vb, va);
+			break;
+		case OP_LEFT | OP_RIGHT:
+			v = _mm_xor_si128(va, vb);
+			break;
+		default:
+			v = _mm_or_si128(va, vb);
+			break;
+		}
+		_mm_storeu_si128((__m128i*) &a[i], v);
+	}
+#endif
+	for (; i < n; i++) {
+		switch (op) {
+		case OP_BOTH:
+			a[i] &= b[i];
+			break;
+		case OP_LEFT:
+			a[i] &= ~b[i];
+			break;
+		case OP_LEFT | OP_RIGHT:
+			a[i] ^= b[i];
+			break;
+		default:
+			a[i] |= b[i];
+			break;
+		}
+	}
+}
+
+/* tight bounds of the set bits, false if there are none */
+static bool BitmapBounds(const Uint64 *bits, const Rect *frame, Rect *bounds)
+{
+	const Uint32 pitch = frame->w / 64;
+	Sint32 x1 = INT32_MAX, x2 = INT32_MIN;
+	Sint32 y1 = INT32_MAX, y2 = INT32_MIN;
+
+	for (Sint32 y = 0; y < frame->h; y++) {
+		const Uint64 *const row = &bits[y * pitch];
+		for (Uint32 w = 0; w < pitch; w++) {
+			if (row[w] == 0) {
+				continue;
 			}
+			x1 = MIN(x1, (Sint32) (w * 64) +
+					__builtin_ctzll(row[w]));
+			x2 = MAX(x2, (Sint32) (w * 64 + 64) -
+					__builtin_clzll(row[w]));
+			y1 = MIN(y1, y);
+			y2 = y + 1;
 		}
+	}
+	if (y2 == INT32_MIN) {
+		return false;
+	}
+	bounds->x = frame->x + x1;
+	bounds->y = frame->y + y1;
+	bounds->w = x2 - x1;
+	bounds->h = y2 - y1;
+	return true;
+}
 
-		if (yi == ys) {
-			r.h++;
-		} else {
-			/* there exist some rectangles interfering with the
-			 * scanline
-			 */
-			if (r.h > 0) {
-				r.x = reg1->bounds.x;
-				r.w = reg1->bounds.w;
-				region_AddRect(reg, &r);
-				r.y += r.h;
+/* turns the runs of each row into rects and merges a row into the band
+ * above when the runs are the same; fails when there are more than
+ * limit rects */
+static bool BitmapToRects(const Uint64 *bits, const Rect *frame,
+		Uint32 limit, struct region_out *out)
+{
+	const Uint32 pitch = frame->w / 64;
+	Uint32 band = 0, bandEnd = 0;
+
+	for (Sint32 y = 0; y < frame->h; y++) {
+		const Uint64 *const row = &bits[y * pitch];
+		const Uint32 start = out->numRects;
+		Sint32 x = 0;
+
+		while (x < frame->w) {
+			Uint64 word = row[x / 64] >> (x % 64);
+			Sint32 x1, x2;
+
+			/* find the start of the next run... */
+			if (word == 0) {
+				x = (x / 64 + 1) * 64;
+				continue;
 			}
-			Rect rx[yi - ys + 1];
-			memcpy(rx, &reg1->rects[ys], sizeof(*rx) * (yi - ys));
-			qsort(rx, yi - ys, sizeof(*rx), CompareRectsX);
-			rx[yi - ys] = (Rect) { reg1->bounds.x + reg1->bounds.w,
-				r.y, 0, 1 };
-			r.x = reg1->bounds.x;
-			for (Uint32 xi = 0; xi <= yi - ys; xi++) {
-				if (rx[xi].y + rx[xi].h <= r.y ||
-						rx[xi].x + rx[xi].w <= r.x) {
-					continue;
+			x1 = x + __builtin_ctzll(word);
+			/* ...and its end */
+			x2 = x1;
+			for (;;) {
+				word = ~row[x2 / 64] >> (x2 % 64);
+				if (word != 0) {
+					x2 += __builtin_ctzll(word);
+					break;
+				}
+				x2 = (x2 / 64 + 1) * 64;
+				if (x2 >= frame->w) {
+					x2 = frame->w;
+					break;
 				}
-				r.w = rx[xi].x - r.x;
-				if (r.w > 0) {
-					Uint32 j;
-
-					/* join rects that align perfectly */
-					for (j = 0; j < reg->numRects; j++) {
-						const Rect ro = reg->rects[j];
-						if (ro.y + ro.h != r.y) {
-							continue;
-						}
-						if (ro.x == r.x &&
-								ro.w == r.w) {
-							reg->rects[j].h++;
-							break;
-						}
-					}
-					/* if nothing was joined,
-					 * add the rect */
-					if (j == reg->numRects) {
-						r.h = 1;
-						region_AddRect(reg, &r);
-					}
+			}
+			PushRect(out, frame->x + x1, frame->x + x2,
+					frame->y + y, frame->y + y + 1);
+			x = x2;
+		}
+		if (out->failed) {
+			return false;
+		}
+
+		const Uint32 n = out->numRects - start;
+		if (n != 0 && bandEnd - band == n &&
+				out->rects[band].y + out->rects[band].h ==
+				frame->y + y) {
+			Uint32 k;
+
+			for (k = 0; k < n; k++) {
+				if (out->rects[band + k].x !=
+						out->rects[start + k].x ||
+						out->rects[band + k].w !=
+						out->rects[start + k].w) {
+					break;
+				}
+			}
+			if (k == n) {
+				for (k = 0; k < n; k++) {
+					out->rects[band + k].h++;
 				}
-				r.x = rx[xi].x + rx[xi].w;
+				out->numRects = start;
+				continue;
 			}
-			r.y++;
-			r.h = 0;
 		}
+		if (n != 0) {
+			band = start;
+			bandEnd = out->numRects;
+		}
+		if (out->numRects > limit) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* replaces the contents of reg with a bitmap, bits belongs to reg->uni;
+ * the bitmap is turned into rects if it is simple enough */
+static Region *SetBitmap(Region *reg, Uint64 *bits, const Rect *frame)
+{
+	struct region_out out;
+	Rect bounds;
+
+	if (!BitmapBounds(bits, frame, &bounds)) {
+		union_Free(reg->uni, bits);
+		return region_SetEmpty(reg);
 	}
-	if (r.h > 0) {
-		r.x = reg1->bounds.x;
-		r.w = reg1->bounds.w;
-		region_AddRect(reg, &r);
+
+	InitOut(&out, reg->uni);
+	if (BitmapToRects(bits, frame, BITMAP_BACK, &out)) {
+		union_Free(reg->uni, bits);
+		TakeOut(reg, &out);
+		reg->bounds = bounds;
+		return reg;
 	}
+	FreeOut(&out);
+
+	region_SetEmpty(reg);
+	reg->bits = bits;
+	reg->frame = *frame;
+	reg->bounds = bounds;
 	return reg;
 }
 
+void region_SetBitmapLimits(Uint32 minRects, Uint32 wordsPerRect)
+{
+	region_minRects = minRects;
+	region_wordsPerRect = wordsPerRect;
+}
+
+static Uint64 BitmapWords(const Rect *bounds)
+{
+	const Sint32 w = AlignUp(bounds->x + bounds->w) - AlignDown(bounds->x);
+	return (Uint64) w / 64 * bounds->h;
+}
+
+/* a bitmap is worth as many rects as it takes to cost the same */
+static Uint64 RectWorth(const Region *reg)
+{
+	if (reg->bits == NULL) {
+		return reg->numRects;
+	}
+	if (region_wordsPerRect == 0) {
+		return 0;
+	}
+	return (BitmapWords(&reg->frame) + region_wordsPerRect - 1) /
+		region_wordsPerRect;
+}
+
+/* whether a bitmap of the bounds costs no more than numRects rects */
+static bool DenseEnough(const Rect *bounds, Uint64 numRects)
+{
+	return BitmapWords(bounds) <= numRects * region_wordsPerRect;
+}
+
+static Region *BitmapOp(Region *reg, const Region *reg1, const Region *reg2,
+		int op, const Rect *bounds)
+{
+	Uint64 *a, *b;
+	Rect frame;
+	Size n;
+
+	frame.x = AlignDown(bounds->x);
+	frame.y = bounds->y;
+	frame.w = AlignUp(bounds->x + bounds->w) - frame.x;
+	frame.h = bounds->h;
+	n = (Size) frame.w / 64 * frame.h;
+
+	a = union_Alloc(reg->uni, sizeof(*a) * n);
+	if (a == NULL) {
+		return NULL;
+	}
+	b = union_Alloc(reg->uni, sizeof(*b) * n);
+	if (b == NULL) {
+		union_Free(reg->uni, a);
+		return NULL;
+	}
+	memset(a, 0, sizeof(*a) * n);
+	memset(b, 0, sizeof(*b) * n);
+	Rasterize(reg1, a, &frame);
+	Rasterize(reg2, b, &frame);
+	CombineBits(a, b, n, op);
+	union_Free(reg->uni, b);
+	return SetBitmap(reg, a, &frame);
+}
+
+/* the area an operation can touch */
+static bool OpBounds(const Region *reg1, const Region *reg2, int op,
+		Rect *bounds)
+{
+	const bool empty1 = reg1->numRects == 0 && reg1->bits == NULL;
+	const bool empty2 = reg2->numRects == 0 && reg2->bits == NULL;
+
+	if (op == OP_BOTH) {
+		return !empty1 && !empty2 &&
+			rect_Intersect(&reg1->bounds, &reg2->bounds, bounds);
+	}
+	if (op == OP_LEFT || empty2) {
+		*bounds = reg1->bounds;
+		return !empty1;
+	}
+	if (empty1) {
+		*bounds = reg2->bounds;
+		return true;
+	}
+	bounds->x = MIN(reg1->bounds.x, reg2->bounds.x);
+	bounds->y = MIN(reg1->bounds.y, reg2->bounds.y);
+	bounds->w = MAX(reg1->bounds.x + reg1->bounds.w,
+			reg2->bounds.x + reg2->bounds.w) - bounds->x;
+	bounds->h = MAX(reg1->bounds.y + reg1->bounds.h,
+			reg2->bounds.y + reg2->bounds.h) - bounds->y;
+	return true;
+}
+
+/* a bitmap as rects no matter how many there are, into tmp */
+static Region *ExpandBitmap(const Region *reg, Region *tmp)
+{
+	struct region_out out;
+
+	InitOut(&out, tmp->uni);
+	if (!BitmapToRects(reg->bits, &reg->frame, UINT32_MAX, &out)) {
+		FreeOut(&out);
+		return NULL;
+	}
+	TakeOut(tmp, &out);
+	tmp->bounds = reg->bounds;
+	return tmp;
+}
+
+/* picks the representation: results with many rects become bitmaps and
+ * bitmaps stay bitmaps as long as the bitmap is not much more than the
+ * rects would be */
+static Region *RegionOp(Region *reg, const Region *reg1, const Region *reg2,
+		int op)
+{
+	Region tmp1, tmp2;
+	Region *r;
+	Rect bounds;
+
+	if (reg1->bits == NULL && reg2->bits == NULL) {
+		r = RectOp(reg, reg1, reg2, op);
+		if (r != NULL && r->numRects >= region_minRects &&
+				r->numRects > REGION_INLINE &&
+				DenseEnough(&r->bounds, r->numRects)) {
+			/* more rects than fit inline, so the copy does
+			 * not point into r */
+			const Region copy = *r;
+			Region empty;
+
+			region_Init(&empty, NULL);
+			/* on failure the rects are still there */
+			BitmapOp(r, &copy, &empty, OP_LEFT, &copy.bounds);
+		}
+		return r;
+	}
+
+	if (!OpBounds(reg1, reg2, op, &bounds)) {
+		return region_SetEmpty(reg);
+	}
+	if (DenseEnough(&bounds, RectWorth(reg1) + RectWorth(reg2))) {
+		return BitmapOp(reg, reg1, reg2, op, &bounds);
+	}
+
+	/* too big for a bitmap, fall back to rects */
+	region_Init(&tmp1, reg->uni);
+	region_Init(&tmp2, reg->uni);
+	r = reg;
+	if (reg1->bits != NULL && ExpandBitmap(reg1, &tmp1) == NULL) {
+		r = NULL;
+	}
+	if (r != NULL && reg2->bits != NULL &&
+			ExpandBitmap(reg2, &tmp2) == NULL) {
+		r = NULL;
+	}
+	if (r != NULL) {
+		r = RectOp(reg, reg1->bits != NULL ? &tmp1 : reg1,
+				reg2->bits != NULL ? &tmp2 : reg2, op);
+	}
+	region_SetEmpty(&tmp1);
+	region_SetEmpty(&tmp2);
+	return r;
+}
+
+/* unites the rects of an arbitrary list by halving it, reg is empty */
+static Region *Build(Region *reg, const Rect *rects, Uint32 num)
+{
+	Region left, right;
+	Region *r;
+
+	if (num == 1) {
+		const Region tmp = RectRegion(&rects[0]);
+		return RegionOp(reg, &tmp, reg, OP_LEFT);
+	}
+	region_Init(&left, reg->uni);
+	region_Init(&right, reg->uni);
+	r = Build(&left, rects, num / 2);
+	if (r != NULL) {
+		r = Build(&right, &rects[num / 2], num - num / 2);
+	}
+	if (r != NULL) {
+		r = RegionOp(reg, &left, &right,
+				OP_LEFT | OP_RIGHT | OP_BOTH);
+	}
+	region_SetEmpty(&left);
+	region_SetEmpty(&right);
+	return r;
+}
+
+Region *region_Optimize(Region *reg)
+{
+	Region tmp;
+
+	/* bitmaps that can be rects already were turned into rects */
+	if (reg->bits != NULL) {
+		return reg;
+	}
+	if (!IsBanded(reg)) {
+		region_Init(&tmp, reg->uni);
+		if (Build(&tmp, reg->rects, reg->numRects) == NULL) {
+			region_SetEmpty(&tmp);
+			return NULL;
+		}
+		FreeRects(reg);
+		MoveRegion(reg, &tmp);
+		if (reg->bits != NULL) {
+			return reg;
+		}
+	}
+	Coalesce(reg);
+	ComputeBounds(reg);
+	return reg;
+}
+
+Region *region_ToRects(Region *reg)
+{
+	Region tmp;
+
+	if (reg->bits == NULL) {
+		return reg;
+	}
+	region_Init(&tmp, reg->uni);
+	if (ExpandBitmap(reg, &tmp) == NULL) {
+		return NULL;
+	}
+	FreeBits(reg);
+	MoveRegion(reg, &tmp);
+	return reg;
+}
+
+Region *region_AddRect(Region *reg, const Rect *rect)
+{
+	const Region tmp = RectRegion(rect);
+
+	if (tmp.numRects == 0) {
+		return reg;
+	}
+	return RegionOp(reg, reg, &tmp, OP_LEFT | OP_RIGHT | OP_BOTH);
+}
+
+Region *region_Intersect(Region *reg, const Region *reg1, const Region *reg2)
+{
+	return RegionOp(reg, reg1, reg2, OP_BOTH);
+}
+
+Region *region_Add(Region *reg, const Region *reg1, const Region *reg2)
+{
+	return RegionOp(reg, reg1, reg2, OP_LEFT | OP_RIGHT | OP_BOTH);
+}
+
+Region *region_Xor(Region *reg, const Region *reg1, const Region *reg2)
+{
+	return RegionOp(reg, reg1, reg2, OP_LEFT | OP_RIGHT);
+}
+
+Region *region_Invert(Region *reg, const Region *reg1)
+{
+	const Region tmp = RectRegion(&reg1->bounds);
+
+	return RegionOp(reg, &tmp, reg1, OP_LEFT);
+}
+
 Region *region_Subtract(Region *reg, const Region *reg1, const Region *reg2)
 {
-	Region *tmp;
+	return RegionOp(reg, reg1, reg2, OP_LEFT);
+}
+
+/* first rect at or after from whose band ends below y */
+static Uint32 FindBand(const Region *reg, Uint32 from, Sint32 y)
+{
+	Uint32 lo = from, hi = reg->numRects;
+
+	while (lo < hi) {
+		const Uint32 mid = lo + (hi - lo) / 2;
+		if (reg->rects[mid].y + reg->rects[mid].h > y) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+/* first rect of the band starting at index band that ends right of x,
+ * may be the start of the next band */
+static Uint32 FindSpan(const Region *reg, Uint32 band, Sint32 x)
+{
+	const Sint32 y = reg->rects[band].y;
+	Uint32 lo = band, hi = reg->numRects;
+
+	while (lo < hi) {
+		const Uint32 mid = lo + (hi - lo) / 2;
+		const Rect *const r = &reg->rects[mid];
+		if (r->y > y || r->x + r->w > x) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+bool region_ContainsPoint(const Region *reg, const Point *p)
+{
+	Uint32 i;
+
+	if (!rect_Contains(&reg->bounds, p)) {
+		return false;
+	}
+	if (reg->bits != NULL) {
+		const Sint32 x = p->x - reg->frame.x;
+		const Sint32 y = p->y - reg->frame.y;
+		return (reg->bits[y * (reg->frame.w / 64) + x / 64] >>
+				(x % 64)) & 1;
+	}
+	i = FindBand(reg, 0, p->y);
+	if (i == reg->numRects || reg->rects[i].y > p->y) {
+		return false;
+	}
+	const Sint32 y = reg->rects[i].y;
+	i = FindSpan(reg, i, p->x);
+	return i < reg->numRects && reg->rects[i].y == y &&
+		reg->rects[i].x <= p->x;
+}
+
+bool region_IntersectsRect(const Region *reg, const Rect *rect)
+{
+	Rect r;
+
+	if ((reg->numRects == 0 && reg->bits == NULL) || IsEmpty(rect) ||
+			!rect_Intersect(&reg->bounds, rect, &r)) {
+		return false;
+	}
+	if (reg->bits != NULL) {
+		const Uint32 pitch = reg->frame.w / 64;
+		const Sint32 x1 = r.x - reg->frame.x;
+		const Sint32 x2 = x1 + r.w;
 
-	reg->numRects = reg1->numRects + reg2->numRects;
-	reg->rects = union_Alloc(reg->uni, sizeof(*reg->rects) * reg->numRects);
-	if (reg->rects == NULL) {
-		union_Free(reg->uni, reg);
+		for (Sint32 y = r.y - reg->frame.y;
+				y < r.y + r.h - reg->frame.y; y++) {
+			const Uint64 *const row = &reg->bits[y * pitch];
+			for (Sint32 w = x1 / 64; w <= (x2 - 1) / 64; w++) {
+				Uint64 mask = ~(Uint64) 0;
+
+				if (w == x1 / 64) {
+					mask &= ~(Uint64) 0 << (x1 % 64);
+				}
+				if (w == (x2 - 1) / 64) {
+					mask &= ~(Uint64) 0 >>
+						(63 - (x2 - 1) % 64);
+				}
+				if (row[w] & mask) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	for (Uint32 i = FindBand(reg, 0, r.y); i < reg->numRects &&
+			reg->rects[i].y < r.y + r.h; ) {
+		const Sint32 y = reg->rects[i].y;
+		const Uint32 j = FindSpan(reg, i, r.x);
+
+		if (j < reg->numRects && reg->rects[j].y == y &&
+				reg->rects[j].x < r.x + r.w) {
+			return true;
+		}
+		/* skip to the next band */
+		i = FindBand(reg, j, y + reg->rects[i].h);
+	}
+	return false;
+}
+
+static inline Uint64 GetWord(const Uint64 *row, Uint32 pitch, Sint32 w)
+{
+	return w >= 0 && (Uint32) w < pitch ? row[w] : 0;
+}
+
+/* moves a bitmap by a distance that is not a multiple of 64, the frame
+ * is made from the bounds again so that it does not grow with each move */
+static Region *ShiftBitmap(Region *reg, Sint32 dx)
+{
+	const Uint32 pitch = reg->frame.w / 64;
+	const Sint32 x = AlignDown(reg->bounds.x + dx);
+	const Uint32 newPitch = MAX((AlignUp(reg->bounds.x + reg->bounds.w +
+				dx) - x) / 64, 1);
+	/* where the first new word starts in the old row */
+	const Sint32 offset = x - dx - reg->frame.x;
+	const Sint32 s = offset & 63;
+	const Sint32 k = (offset - s) / 64;
+	Uint64 *bits;
+
+	bits = union_Alloc(reg->uni, sizeof(*bits) * newPitch * reg->frame.h);
+	if (bits == NULL) {
 		return NULL;
 	}
-	/* Fact used: Subtracting a region is the same as intersecting with
-	 * the inverse of that region.
-	 * So: A without B = A intersect ~B
-	 * Proof:
-	 * Let x in A without B, that is equivalent to
-	 * x in A and x not in B which is equivalent to
-	 * x in A and x in ~B which is the same as
-	 * x in A intersect ~B.
-	 */
-	tmp = region_Create_u(reg->uni);
-	region_Invert(tmp, (Region*) reg2);
-	reg = region_Intersect(reg, reg1, tmp);
-	region_Delete(tmp);
+	for (Sint32 y = 0; y < reg->frame.h; y++) {
+		const Uint64 *const src = &reg->bits[y * pitch];
+		Uint64 *const dst = &bits[y * newPitch];
+
+		for (Uint32 w = 0; w < newPitch; w++) {
+			dst[w] = GetWord(src, pitch, k + w) >> s;
+			if (s != 0) {
+				dst[w] |= GetWord(src, pitch, k + w + 1) <<
+					(64 - s);
+			}
+		}
+	}
+	union_Free(reg->uni, reg->bits);
+	reg->bits = bits;
+	reg->frame.x = x;
+	reg->frame.w = newPitch * 64;
 	return reg;
 }
 
 Region *region_MoveBy(Region *reg, Sint32 dx, Sint32 dy)
 {
+	if (reg->bits != NULL) {
+		if (dx % 64 != 0 && ShiftBitmap(reg, dx) == NULL) {
+			return NULL;
+		}
+		if (dx % 64 == 0) {
+			reg->frame.x += dx;
+		}
+		reg->frame.y += dy;
+	}
 	for (Uint32 i = 0; i < reg->numRects; i++) {
 		reg->rects[i].x += dx;
 		reg->rects[i].y += dy;
@@ -287,6 +1109,7 @@ Region *region_MoveBy(Region *reg, Sint32 dx, Sint32 dy)
 
 void region_Delete(Region *reg)
 {
-	union_Free(reg->uni, reg->rects);
+	FreeBits(reg);
+	FreeRects(reg);
 	union_Free(reg->uni, reg);
 }
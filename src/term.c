@@ -184,6 +184,44 @@ static void term_Delete(struct term *term, Uint32 from, Uint32 to)
 	buf[term->lenSection] = '\0';
 }
 
+/* frame stats in the top right corner, it repaints itself every frame
+ * while it is shown */
+static void DrawFrameOverlay(void)
+{
+	FrameStats stats;
+	char line[64];
+	Rect r, area;
+	int lineSkip;
+
+	gui_GetFrameStats(&stats);
+	lineSkip = renderer_LineSkip();
+	area.w = 320;
+	area.h = lineSkip * (FRAME_PHASE_MAX + 2);
+	area.x = gui_GetWindowWidth() - area.w;
+	area.y = 0;
+	renderer_SetDrawColor(0x000000);
+	renderer_FillRect(&area);
+	renderer_SetDrawColor(0xffffff);
+
+	r.x = area.x;
+	r.y = area.y;
+	snprintf(line, sizeof(line), "%u frames, us p50/p95/p99/max",
+			stats.numFrames);
+	renderer_DrawText(line, strlen(line), &r);
+	for (Uint32 i = 0; i <= FRAME_PHASE_MAX; i++) {
+		const PhaseStats *const p = i == FRAME_PHASE_MAX ?
+			&stats.total : &stats.phases[i];
+
+		r.y += lineSkip;
+		snprintf(line, sizeof(line), "%-8s %u/%u/%u/%u",
+				i == FRAME_PHASE_MAX ? "total" :
+				gui_phaseNames[i],
+				p->p50, p->p95, p->p99, p->max);
+		renderer_DrawText(line, strlen(line), &r);
+	}
+	gui_Invalidate(&area);
+}
+
 int BaseProc(View *view, event_t type, EventInfo *info)
 {
 	static struct term term;
@@ -192,8 +230,6 @@ int BaseProc(View *view, event_t type, EventInfo *info)
 	Uint32 index;
 	int lineSkip;
 
-	(void) view;
-
 	if (term.sections == NULL) {
 		term.sections = union_Alloc(union_Default(),
 				sizeof(*term.sections));
@@ -224,6 +260,9 @@ int BaseProc(View *view, event_t type, EventInfo *info)
 		ext.y += r.y;
 		ext.w = 2;
 		renderer_FillRect(&ext);
+		if (gui_HasFrameOverlay()) {
+			DrawFrameOverlay();
+		}
 		break;
 
 	case EVENT_KEYDOWN:
@@ -294,10 +333,12 @@ int BaseProc(View *view, event_t type, EventInfo *info)
 			term_NextSection(&term);
 			break;
 		}
+		view_Invalidate(view);
 		break;
 
 	case EVENT_TEXTINPUT:
 		term_Append(&term, info->ti.text, strlen(info->ti.text));
+		view_Invalidate(view);
 		break;
 	default:
 	}
@@ -0,0 +1,110 @@
+#include "gui.h"
+
+static struct trace {
+	FILE *fp;
+	Uint64 start;
+	Uint64 freq;
+	/* no comma before the first event */
+	bool first;
+	/* spans begun while tracing, so that spans begun before tracing
+	 * do not end in it and open spans are ended when it stops */
+	Uint32 depth;
+} trace;
+
+static void WriteString(const char *str)
+{
+	fputc('"', trace.fp);
+	for (; *str != '\0'; str++) {
+		const Uint8 c = *str;
+
+		if (c == '"' || c == '\\') {
+			fputc('\\', trace.fp);
+			fputc(c, trace.fp);
+		} else if (c < ' ') {
+			fprintf(trace.fp, "\\u%04x", c);
+		} else {
+			fputc(c, trace.fp);
+		}
+	}
+	fputc('"', trace.fp);
+}
+
+/* microseconds since trace_Start() */
+static double GetTimestamp(void)
+{
+	return (double) (SDL_GetPerformanceCounter() - trace.start) *
+		1e6 / trace.freq;
+}
+
+static void WriteEvent(char phase, const char *category, const char *name,
+		const char *detail)
+{
+	fprintf(trace.fp, "%s\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+			trace.first ? "" : ",", phase, GetTimestamp());
+	trace.first = false;
+	if (category != NULL) {
+		fputs(",\"cat\":", trace.fp);
+		WriteString(category);
+	}
+	if (name != NULL) {
+		fputs(",\"name\":", trace.fp);
+		WriteString(name);
+	}
+	if (detail != NULL) {
+		fputs(",\"args\":{\"detail\":", trace.fp);
+		WriteString(detail);
+		fputc('}', trace.fp);
+	}
+	fputc('}', trace.fp);
+}
+
+int trace_Start(const char *path)
+{
+	trace_Stop();
+	trace.fp = fopen(path, "w");
+	if (trace.fp == NULL) {
+		return -1;
+	}
+	trace.start = SDL_GetPerformanceCounter();
+	trace.freq = SDL_GetPerformanceFrequency();
+	trace.first = true;
+	trace.depth = 0;
+	fputs("[", trace.fp);
+	return 0;
+}
+
+void trace_Stop(void)
+{
+	if (trace.fp == NULL) {
+		return;
+	}
+	for (; trace.depth > 0; trace.depth--) {
+		WriteEvent('E', NULL, NULL, NULL);
+	}
+	fputs("\n]\n", trace.fp);
+	fclose(trace.fp);
+	trace.fp = NULL;
+}
+
+bool trace_IsRunning(void)
+{
+	return trace.fp != NULL;
+}
+
+void trace_Begin(const char *category, const char *name, const char *detail)
+{
+	if (trace.fp == NULL) {
+		return;
+	}
+	WriteEvent('B', category, name, detail);
+	trace.depth++;
+}
+
+void trace_End(void)
+{
+	if (trace.depth == 0) {
+		return;
+	}
+	WriteEvent('E', NULL, NULL, NULL);
+	trace.depth--;
+}
@@ -1,17 +1,563 @@
 #include "gui.h"
 
+#define INDEX_EMPTY 0
+#define INDEX_DELETED UINT32_MAX
+
+#define MIN_INDEX 16
+
+/* every arena allocation is prefixed with its size */
+#define ARENA_ALIGN 16
+#define ARENA_HEADER ARENA_ALIGN
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(Size) (ARENA_ALIGN - 1))
+
+struct mem_chunk {
+	struct mem_chunk *prev;
+	Size size;
+	Size used;
+	/* bytes handed out from this chunk */
+	Size allocated;
+	/* number of allocations in all previous chunks */
+	Uint32 first;
+};
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(struct mem_chunk))
+
+/* small allocations of regular unions come from slabs shared by all
+ * unions, a pointer belongs to a slab if its size maps to a class */
+#define SLAB_SIZE 16384
+
+static const Size slab_classes[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 320
+};
+
+static struct slab_pool {
+	/* freed slots, the first bytes of a slot point to the next one */
+	void *free;
+	char *cur, *end;
+} slab_pools[ARRLEN(slab_classes)];
+
+#define FRAME_ARENA 16384
+
 Union default_union = { .limit = SIZE_MAX };
+Union frame_union = { .chunkSize = FRAME_ARENA, .limit = SIZE_MAX };
 
 Union *union_Default(void)
 {
 	return &default_union;
 }
 
+Union *union_Frame(void)
+{
+	return &frame_union;
+}
+
 void union_Init(Union *uni, size_t limit)
 {
 	uni->pointers = NULL;
 	uni->numPointers = 0;
+	uni->capPointers = 0;
+	uni->numHoles = 0;
+	uni->numMarks = 0;
+	uni->index = NULL;
+	uni->capIndex = 0;
+	uni->numIndexUsed = 0;
+	uni->chunks = NULL;
+	uni->chunkSize = 0;
+	uni->movedFrom = 0;
+	uni->movedTo = 0;
 	uni->limit = limit;
+	uni->allocated = 0;
+	memset(&uni->stats, 0, sizeof(uni->stats));
+}
+
+void union_InitArena(Union *uni, Size chunkSize, Size limit)
+{
+	union_Init(uni, limit);
+	uni->chunkSize = MAX(ALIGN_UP(chunkSize), (Size) 256);
+}
+
+static inline int SlabClass(Size sz)
+{
+	for (int c = 0; c < (int) ARRLEN(slab_classes); c++) {
+		if (sz <= slab_classes[c]) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+static void *SlabAlloc(int c)
+{
+	struct slab_pool *const pool = &slab_pools[c];
+	const Size size = slab_classes[c];
+	void *ptr;
+
+	if (pool->free != NULL) {
+		ptr = pool->free;
+		pool->free = *(void**) ptr;
+		return ptr;
+	}
+	if (pool->cur == pool->end) {
+		/* slabs are never given back, their slots are reused */
+		pool->cur = malloc(SLAB_SIZE - SLAB_SIZE % size);
+		if (pool->cur == NULL) {
+			pool->end = NULL;
+			return NULL;
+		}
+		pool->end = pool->cur + SLAB_SIZE - SLAB_SIZE % size;
+	}
+	ptr = pool->cur;
+	pool->cur += size;
+	return ptr;
+}
+
+static void SlabFree(int c, void *ptr)
+{
+	struct slab_pool *const pool = &slab_pools[c];
+
+	*(void**) ptr = pool->free;
+	pool->free = ptr;
+}
+
+static void *SysAlloc(Size sz)
+{
+	const int c = SlabClass(sz);
+
+	if (c >= 0) {
+		return SlabAlloc(c);
+	}
+	return malloc(sz);
+}
+
+static void SysFree(void *ptr, Size sz)
+{
+	const int c = SlabClass(sz);
+
+	if (c >= 0) {
+		SlabFree(c, ptr);
+	} else {
+		free(ptr);
+	}
+}
+
+static void *SysRealloc(void *ptr, Size oldSize, Size sz)
+{
+	const int oc = SlabClass(oldSize);
+	const int nc = SlabClass(sz);
+	void *newPtr;
+
+	if (oc == nc && oc >= 0) {
+		return ptr;
+	}
+	if (oc < 0 && nc < 0) {
+		return realloc(ptr, sz);
+	}
+	newPtr = SysAlloc(sz);
+	if (newPtr == NULL) {
+		return NULL;
+	}
+	memcpy(newPtr, ptr, MIN(oldSize, sz));
+	SysFree(ptr, oldSize);
+	return newPtr;
+}
+
+static inline Uint32 HashPointer(const void *ptr)
+{
+	Uint64 h;
+
+	/* finalizer of murmur3, malloc pointers are aligned so the
+	 * lower bits alone would be a bad hash */
+	h = (Uint64) (uintptr_t) ptr;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (Uint32) h;
+}
+
+static Uint32 FindSlot(Union *uni, const void *ptr)
+{
+	Uint32 mask, slot, entry;
+
+	uni->stats.numLookups++;
+	if (uni->capIndex == 0 || ptr == NULL) {
+		return UINT32_MAX;
+	}
+	mask = uni->capIndex - 1;
+	slot = HashPointer(ptr) & mask;
+	/* the index is never full, so this terminates */
+	while (uni->stats.numProbes++,
+			(entry = uni->index[slot]) != INDEX_EMPTY) {
+		if (entry != INDEX_DELETED &&
+				uni->pointers[entry - 1].sys == ptr) {
+			return slot;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return UINT32_MAX;
+}
+
+static void InsertSlot(Union *uni, Uint32 index)
+{
+	Uint32 mask, slot;
+
+	mask = uni->capIndex - 1;
+	slot = HashPointer(uni->pointers[index].sys) & mask;
+	while (uni->index[slot] != INDEX_EMPTY &&
+			uni->index[slot] != INDEX_DELETED) {
+		slot = (slot + 1) & mask;
+	}
+	if (uni->index[slot] == INDEX_EMPTY) {
+		uni->numIndexUsed++;
+	}
+	uni->index[slot] = index + 1;
+}
+
+static int RebuildIndex(Union *uni)
+{
+	Uint32 *newIndex;
+	Uint32 cap;
+	const Uint32 numLive = uni->numPointers - uni->numHoles;
+
+	/* keep the load below one half after a rebuild */
+	for (cap = MIN_INDEX; cap < (numLive + 1) * 2; ) {
+		cap *= 2;
+	}
+	newIndex = calloc(cap, sizeof(*newIndex));
+	if (newIndex == NULL) {
+		PRINT_DEBUG();
+		fprintf(stderr, "system error after an attempt"
+				" to allocate an index of size %u: %s\n",
+				cap, strerror(errno));
+		return -1;
+	}
+	free(uni->index);
+	uni->index = newIndex;
+	uni->capIndex = cap;
+	uni->numIndexUsed = 0;
+	for (Uint32 i = 0; i < uni->numPointers; i++) {
+		if (uni->pointers[i].sys != NULL) {
+			InsertSlot(uni, i);
+		}
+	}
+	return 0;
+}
+
+/* makes sure that one more pointer can be indexed without a rebuild */
+static int ReserveIndex(Union *uni)
+{
+	if ((uni->numIndexUsed + 1) * 4 <= uni->capIndex * 3) {
+		return 0;
+	}
+	return RebuildIndex(uni);
+}
+
+static void Compact(Union *uni)
+{
+	Uint32 n = 0;
+
+	for (Uint32 i = 0; i < uni->numPointers; i++) {
+		if (uni->pointers[i].sys != NULL) {
+			uni->pointers[n++] = uni->pointers[i];
+		}
+	}
+	uni->numPointers = n;
+	uni->numHoles = 0;
+	/* the old table is large enough to hold the remaining pointers,
+	 * only reuse it if a smaller one can not be allocated */
+	if (RebuildIndex(uni) < 0) {
+		memset(uni->index, 0, sizeof(*uni->index) * uni->capIndex);
+		uni->numIndexUsed = 0;
+		for (Uint32 i = 0; i < uni->numPointers; i++) {
+			InsertSlot(uni, i);
+		}
+	}
+}
+
+static inline char *ChunkData(struct mem_chunk *chunk)
+{
+	return (char*) chunk + CHUNK_HEADER;
+}
+
+static inline Size *ArenaHeader(void *ptr)
+{
+	return (Size*) ((char*) ptr - ARENA_HEADER);
+}
+
+static inline bool ArenaIsLast(Union *uni, void *ptr)
+{
+	struct mem_chunk *const chunk = uni->chunks;
+
+	if (chunk == NULL || ptr == NULL) {
+		return false;
+	}
+	return (char*) ptr + ALIGN_UP(*ArenaHeader(ptr)) ==
+		ChunkData(chunk) + chunk->used;
+}
+
+static struct mem_chunk *ArenaFindChunk(Union *uni, const void *ptr)
+{
+	uni->stats.numLookups++;
+	for (struct mem_chunk *chunk = uni->chunks; chunk != NULL;
+			chunk = chunk->prev) {
+		uni->stats.numProbes++;
+		if ((const char*) ptr >= ChunkData(chunk) &&
+				(const char*) ptr < ChunkData(chunk) + chunk->used) {
+			return chunk;
+		}
+	}
+	return NULL;
+}
+
+/* the allocation number of a pointer within its chunk */
+static Uint32 ArenaNumber(struct mem_chunk *chunk, const void *ptr)
+{
+	Uint32 n = chunk->first;
+
+	for (Size u = 0; ChunkData(chunk) + u + ARENA_HEADER !=
+			(const char*) ptr; n++) {
+		u += ARENA_HEADER + ALIGN_UP(*(Size*) (ChunkData(chunk) + u));
+	}
+	return n;
+}
+
+static void *ArenaAlloc(Union *uni, Size sz)
+{
+	struct mem_chunk *chunk;
+	Size need, size;
+	char *data;
+
+	need = ARENA_HEADER + ALIGN_UP(sz);
+	chunk = uni->chunks;
+	if (chunk == NULL || chunk->used + need > chunk->size) {
+		size = MAX(uni->chunkSize, need);
+		chunk = malloc(CHUNK_HEADER + size);
+		if (chunk == NULL) {
+			PRINT_DEBUG();
+			fprintf(stderr, "system error after an attempt"
+					" to allocate a chunk of %zu bytes: %s\n",
+					size, strerror(errno));
+			return NULL;
+		}
+		chunk->prev = uni->chunks;
+		chunk->size = size;
+		chunk->used = 0;
+		chunk->allocated = 0;
+		chunk->first = uni->numPointers;
+		uni->chunks = chunk;
+	}
+	data = ChunkData(chunk) + chunk->used;
+	*(Size*) data = sz;
+	chunk->used += need;
+	chunk->allocated += sz;
+	uni->numPointers++;
+	uni->allocated += sz;
+	return data + ARENA_HEADER;
+}
+
+/* only the last allocation can actually be given back */
+static int ArenaFree(Union *uni, void *ptr)
+{
+	struct mem_chunk *chunk;
+	Size sz;
+
+	if (!ArenaIsLast(uni, ptr)) {
+		if (ArenaFindChunk(uni, ptr) == NULL) {
+			PRINT_DEBUG();
+			fprintf(stderr, "trying to free non existant pointer %p\n",
+					ptr);
+			return -1;
+		}
+		return 0;
+	}
+	chunk = uni->chunks;
+	sz = *ArenaHeader(ptr);
+	chunk->used -= ARENA_HEADER + ALIGN_UP(sz);
+	chunk->allocated -= sz;
+	uni->numPointers--;
+	uni->allocated -= sz;
+	if (uni->numPointers <= uni->movedFrom) {
+		/* the copies are all above their originals */
+		uni->movedTo = 0;
+	}
+	if (chunk->used == 0) {
+		uni->chunks = chunk->prev;
+		free(chunk);
+	}
+	return 0;
+}
+
+static void *ArenaRealloc(Union *uni, void *ptr, Size sz)
+{
+	struct mem_chunk *chunk, *from;
+	Size oldSize;
+	Uint32 number;
+	void *newPtr;
+
+	from = ArenaFindChunk(uni, ptr);
+	if (from == NULL) {
+		PRINT_DEBUG();
+		fprintf(stderr, "trying to reallocate non existant pointer"
+				" %p to size %zu\n", ptr, sz);
+		return NULL;
+	}
+	oldSize = *ArenaHeader(ptr);
+	if (uni->allocated - oldSize + sz > uni->limit) {
+		PRINT_DEBUG();
+		fprintf(stderr, "limit exceeded old=%zu, new=%zu but limit=%zu\n",
+				uni->allocated,
+				uni->allocated - oldSize + sz,
+				uni->limit);
+		return NULL;
+	}
+
+	chunk = uni->chunks;
+	if (ArenaIsLast(uni, ptr) && (char*) ptr + ALIGN_UP(sz) <=
+			ChunkData(chunk) + chunk->size) {
+		chunk->used += ALIGN_UP(sz);
+		chunk->used -= ALIGN_UP(oldSize);
+		chunk->allocated += sz;
+		chunk->allocated -= oldSize;
+		uni->allocated += sz;
+		uni->allocated -= oldSize;
+		*ArenaHeader(ptr) = sz;
+		return ptr;
+	}
+	if (sz <= oldSize) {
+		/* shrinking in the middle, the rest stays unused */
+		return ptr;
+	}
+
+	/* the old allocation stays in its chunk */
+	if (uni->allocated + sz > uni->limit) {
+		PRINT_DEBUG();
+		fprintf(stderr, "limit exceeded old=%zu, new=%zu but limit=%zu\n",
+				uni->allocated, uni->allocated + sz,
+				uni->limit);
+		return NULL;
+	}
+
+	number = ArenaNumber(from, ptr);
+	newPtr = ArenaAlloc(uni, sz);
+	if (newPtr == NULL) {
+		return NULL;
+	}
+	memcpy(newPtr, ptr, oldSize);
+	/* remembered so union_Trim() does not free the copy of a pointer
+	 * below its mark */
+	if (uni->movedTo == 0 || number < uni->movedFrom) {
+		uni->movedFrom = number;
+	}
+	uni->movedTo = uni->numPointers - 1;
+	return newPtr;
+}
+
+static void ArenaTrim(Union *uni, Uint32 numPointers)
+{
+	struct mem_chunk *chunk;
+	Size used, sz;
+
+	if (uni->movedTo >= numPointers && uni->movedFrom < numPointers) {
+		PRINT_DEBUG();
+		fprintf(stderr, "trying to trim to %u but pointer %u was"
+				" moved above it by a reallocation\n",
+				numPointers, uni->movedFrom);
+		return;
+	}
+	if (numPointers <= uni->movedFrom) {
+		uni->movedTo = 0;
+	}
+
+	if (uni->numPointers > numPointers) {
+		uni->stats.numFrees += uni->numPointers - numPointers;
+	}
+
+	while ((chunk = uni->chunks) != NULL && chunk->first >= numPointers) {
+		uni->allocated -= chunk->allocated;
+		uni->chunks = chunk->prev;
+		free(chunk);
+	}
+	if (chunk == NULL || uni->numPointers <= numPointers) {
+		uni->numPointers = MIN(uni->numPointers, numPointers);
+		return;
+	}
+
+	/* find the start of the allocation with the given number, this
+	 * walks the chunk which is still cheaper than a free per pointer */
+	used = 0;
+	for (Uint32 n = chunk->first; n < numPointers; n++) {
+		used += ARENA_HEADER + ALIGN_UP(*(Size*) (ChunkData(chunk) + used));
+	}
+	for (Size u = used; u < chunk->used; ) {
+		sz = *(Size*) (ChunkData(chunk) + u);
+		chunk->allocated -= sz;
+		uni->allocated -= sz;
+		u += ARENA_HEADER + ALIGN_UP(sz);
+	}
+	chunk->used = used;
+	uni->numPointers = numPointers;
+}
+
+/* keeps a single chunk large enough for everything that was allocated
+ * so a union that is reset periodically stops calling malloc */
+static void ArenaReset(Union *uni)
+{
+	struct mem_chunk *chunk, *prev;
+	Size total = 0;
+
+	uni->stats.numFrees += uni->numPointers;
+	chunk = uni->chunks;
+	if (chunk != NULL && chunk->prev != NULL) {
+		for (; chunk != NULL; chunk = prev) {
+			prev = chunk->prev;
+			total += chunk->size;
+			free(chunk);
+		}
+		chunk = malloc(CHUNK_HEADER + total);
+		if (chunk != NULL) {
+			chunk->prev = NULL;
+			chunk->size = total;
+		}
+		uni->chunks = chunk;
+	}
+	if (chunk != NULL) {
+		chunk->used = 0;
+		chunk->allocated = 0;
+		chunk->first = 0;
+	}
+	uni->numPointers = 0;
+	uni->movedTo = 0;
+	uni->allocated = 0;
+}
+
+static void ArenaFreeAll(Union *uni)
+{
+	struct mem_chunk *chunk, *prev;
+
+	uni->stats.numFrees += uni->numPointers;
+	for (chunk = uni->chunks; chunk != NULL; chunk = prev) {
+		prev = chunk->prev;
+		free(chunk);
+	}
+	uni->chunks = NULL;
+	uni->numPointers = 0;
+	uni->movedTo = 0;
+	uni->allocated = 0;
+}
+
+static inline void CountAlloc(Union *uni)
+{
+	uni->stats.numAllocs++;
+	if (uni->allocated > uni->stats.peakAllocated) {
+		uni->stats.peakAllocated = uni->allocated;
+	}
+}
+
+static inline void CountRealloc(Union *uni)
+{
+	uni->stats.numReallocs++;
+	if (uni->allocated > uni->stats.peakAllocated) {
+		uni->stats.peakAllocated = uni->allocated;
+	}
 }
 
 void *union_Alloc(Union *uni, size_t sz)
@@ -23,6 +569,7 @@ void *union_Allocf(Union *uni, size_t sz, Uint64 flags)
 {
 	struct mem_ptr *ptrs;
 	struct mem_ptr ptr;
+	Uint32 newCap;
 
 	if (sz == 0) {
 		return NULL;
@@ -36,18 +583,34 @@ void *union_Allocf(Union *uni, size_t sz, Uint64 flags)
 		return NULL;
 	}
 
-	ptrs = realloc(uni->pointers, sizeof(*uni->pointers) *
-			(uni->numPointers + 1));
-	if (ptrs == NULL) {
-		PRINT_DEBUG();
-		fprintf(stderr, "system error after an attempt"
-				" to allocate a shadow: %s\n",
-				strerror(errno));
+	if (uni->chunkSize != 0) {
+		/* flags are not stored for arena allocations */
+		ptr.sys = ArenaAlloc(uni, sz);
+		if (ptr.sys != NULL) {
+			CountAlloc(uni);
+		}
+		return ptr.sys;
+	}
+
+	if (uni->numPointers == uni->capPointers) {
+		newCap = uni->capPointers * 2 + 8;
+		ptrs = realloc(uni->pointers, sizeof(*uni->pointers) * newCap);
+		if (ptrs == NULL) {
+			PRINT_DEBUG();
+			fprintf(stderr, "system error after an attempt"
+					" to allocate a shadow: %s\n",
+					strerror(errno));
+			return NULL;
+		}
+		uni->pointers = ptrs;
+		uni->capPointers = newCap;
+	}
+
+	if (ReserveIndex(uni) < 0) {
 		return NULL;
 	}
-	uni->pointers = ptrs;
 
-	ptr.sys = malloc(sz);
+	ptr.sys = SysAlloc(sz);
 	if (ptr.sys == NULL) {
 		PRINT_DEBUG();
 		fprintf(stderr, "system error after an attempt"
@@ -57,33 +620,40 @@ void *union_Allocf(Union *uni, size_t sz, Uint64 flags)
 	}
 	ptr.size = sz;
 	ptr.flags = flags;
-	uni->pointers[uni->numPointers++] = ptr;
+	uni->pointers[uni->numPointers] = ptr;
+	InsertSlot(uni, uni->numPointers);
+	uni->numPointers++;
 	uni->allocated += sz;
+	CountAlloc(uni);
 	return ptr.sys;
 }
 
 void *union_Realloc(Union *uni, void *ptr, Size sz)
 {
 	struct mem_ptr *oldPtr;
-	struct mem_ptr newPtr;
-	Uint32 index;
+	void *sys;
+	Uint32 slot, index;
 
 	if (ptr == NULL) {
 		return union_Alloc(uni, sz);
 	}
 
-	for (index = 0; index < uni->numPointers; index++) {
-		if (uni->pointers[index].sys == ptr) {
-			break;
+	if (uni->chunkSize != 0) {
+		sys = ArenaRealloc(uni, ptr, sz);
+		if (sys != NULL) {
+			CountRealloc(uni);
 		}
+		return sys;
 	}
 
-	if (index == uni->numPointers) {
+	slot = FindSlot(uni, ptr);
+	if (slot == UINT32_MAX) {
 		PRINT_DEBUG();
 		fprintf(stderr, "trying to reallocate non existant pointer"
 				" %p to size %zu\n", ptr, sz);
 		return NULL;
 	}
+	index = uni->index[slot] - 1;
 
 	oldPtr = &uni->pointers[index];
 
@@ -100,90 +670,223 @@ void *union_Realloc(Union *uni, void *ptr, Size sz)
 		return NULL;
 	}
 
-	newPtr.sys = realloc(ptr, sz);
-	if (newPtr.sys == NULL) {
+	/* the pointer might move, make sure it can be indexed again;
+	 * the rebuild invalidates the slot */
+	if ((uni->numIndexUsed + 1) * 4 > uni->capIndex * 3) {
+		if (RebuildIndex(uni) < 0) {
+			return NULL;
+		}
+		slot = FindSlot(uni, ptr);
+	}
+
+	sys = SysRealloc(ptr, oldPtr->size, sz);
+	if (sys == NULL) {
 		PRINT_DEBUG();
 		fprintf(stderr, "system error after an attempt"
 				" to reallocate %zu bytes to %zu bytes: %s\n",
 				oldPtr->size, sz, strerror(errno));
 		return NULL;
 	}
-	newPtr.size = sz;
-	uni->pointers[index] = newPtr;
-	uni->allocated += newPtr.size - oldPtr->size;
-	return newPtr.sys;
+	uni->allocated += sz;
+	uni->allocated -= oldPtr->size;
+	oldPtr->size = sz;
+	if (sys != ptr) {
+		uni->index[slot] = INDEX_DELETED;
+		oldPtr->sys = sys;
+		InsertSlot(uni, index);
+	}
+	CountRealloc(uni);
+	return sys;
 }
 
 void *union_Mask(Union *uni, Uint64 flags, const void *ptr)
 {
 	Uint32 index;
+	Uint32 slot;
+
+	if (uni->chunkSize != 0) {
+		return NULL;
+	}
 
 	if (ptr != NULL) {
-		for (index = 0; index < uni->numPointers; index++) {
-			if (uni->pointers[index].sys == ptr) {
-				break;
-			}
+		slot = FindSlot(uni, ptr);
+		if (slot == UINT32_MAX) {
+			return NULL;
 		}
+		index = uni->index[slot];
+	} else {
+		index = 0;
 	}
-	for (index++; index < uni->numPointers; index++) {
-		if (uni->pointers[index].flags & flags) {
+	for (; index < uni->numPointers; index++) {
+		if (uni->pointers[index].sys != NULL &&
+				(uni->pointers[index].flags & flags)) {
 			return uni->pointers[index].sys;
 		}
 	}
 	return NULL;
 }
 
+struct mem_ptr *union_Find(Union *uni, const void *ptr)
+{
+	Uint32 slot;
+
+	if (uni->chunkSize != 0) {
+		return NULL;
+	}
+	slot = FindSlot(uni, ptr);
+	if (slot == UINT32_MAX) {
+		return NULL;
+	}
+	return &uni->pointers[uni->index[slot] - 1];
+}
+
 bool union_HasPointer(Union *uni, void *ptr)
 {
-	for (Uint32 i = 0; i < uni->numPointers; i++) {
-		if (uni->pointers[i].sys == ptr) {
-			return true;
-		}
+	if (uni->chunkSize != 0) {
+		return ArenaFindChunk(uni, ptr) != NULL;
 	}
-	return false;
+	return FindSlot(uni, ptr) != UINT32_MAX;
 }
 
 void union_FreeAll(Union *uni)
 {
+	if (uni->chunkSize != 0) {
+		ArenaFreeAll(uni);
+		return;
+	}
+	uni->stats.numFrees += uni->numPointers - uni->numHoles;
 	for (Uint32 i = 0; i < uni->numPointers; i++) {
-		free(uni->pointers[i].sys);
+		if (uni->pointers[i].sys != NULL) {
+			SysFree(uni->pointers[i].sys, uni->pointers[i].size);
+		}
 	}
 	free(uni->pointers);
+	free(uni->index);
 	uni->pointers = NULL;
 	uni->numPointers = 0;
+	uni->capPointers = 0;
+	uni->numHoles = 0;
+	uni->index = NULL;
+	uni->capIndex = 0;
+	uni->numIndexUsed = 0;
+	uni->allocated = 0;
+}
+
+void union_Reset(Union *uni)
+{
+	if (uni->chunkSize != 0) {
+		ArenaReset(uni);
+		return;
+	}
+	uni->stats.numFrees += uni->numPointers - uni->numHoles;
+	for (Uint32 i = 0; i < uni->numPointers; i++) {
+		if (uni->pointers[i].sys != NULL) {
+			SysFree(uni->pointers[i].sys, uni->pointers[i].size);
+		}
+	}
+	if (uni->index != NULL) {
+		memset(uni->index, 0, sizeof(*uni->index) * uni->capIndex);
+	}
+	uni->numPointers = 0;
+	uni->numHoles = 0;
+	uni->numIndexUsed = 0;
 	uni->allocated = 0;
 }
 
 int union_Free(Union *uni, void *ptr)
 {
-	Uint32 index;
+	Uint32 slot, index;
 
-	for (index = 0; index < uni->numPointers; index++) {
-		if (uni->pointers[index].sys == ptr) {
-			break;
+	if (uni->chunkSize != 0) {
+		if (ArenaFree(uni, ptr) < 0) {
+			return -1;
 		}
+		uni->stats.numFrees++;
+		return 0;
 	}
 
-	if (index == uni->numPointers) {
+	slot = FindSlot(uni, ptr);
+	if (slot == UINT32_MAX) {
 		PRINT_DEBUG();
 		fprintf(stderr, "trying to free non existant pointer %p\n",
 				ptr);
 		return -1;
 	}
-	free(ptr);
+	index = uni->index[slot] - 1;
+	uni->index[slot] = INDEX_DELETED;
+	SysFree(ptr, uni->pointers[index].size);
 	uni->allocated -= uni->pointers[index].size;
-	uni->numPointers--;
-	memmove(&uni->pointers[index],
-			&uni->pointers[index + 1],
-			sizeof(*uni->pointers) * (uni->numPointers - index));
+	uni->pointers[index].sys = NULL;
+	uni->pointers[index].size = 0;
+	uni->pointers[index].flags = 0;
+	uni->numHoles++;
+	uni->stats.numFrees++;
+
+	/* pop holes from the top of the stack so that the common
+	 * allocate-use-free pattern does not leave anything behind */
+	while (uni->numPointers > 0 &&
+			uni->pointers[uni->numPointers - 1].sys == NULL) {
+		uni->numPointers--;
+		uni->numHoles--;
+	}
+	/* compacting renumbers the pointers, so not while a mark for
+	 * union_Trim() is outstanding */
+	if (uni->numMarks == 0 && uni->numHoles > MIN_INDEX &&
+			uni->numHoles * 2 > uni->numPointers) {
+		Compact(uni);
+	}
 	return 0;
 }
 
+Uint32 union_Mark(Union *uni)
+{
+	uni->numMarks++;
+	return uni->numPointers;
+}
+
+void union_Unmark(Union *uni)
+{
+	if (uni->numMarks == 0) {
+		PRINT_DEBUG();
+		fprintf(stderr, "trying to give back a mark that was not"
+				" taken\n");
+		return;
+	}
+	uni->numMarks--;
+}
+
 void union_Trim(Union *uni, Uint32 numPointers)
 {
+	struct mem_ptr *ptr;
+	Uint32 slot;
+
+	if (uni->chunkSize != 0) {
+		ArenaTrim(uni, numPointers);
+		return;
+	}
+
 	while (uni->numPointers > numPointers) {
 		uni->numPointers--;
-		free(uni->pointers[uni->numPointers].sys);
-		uni->allocated -= uni->pointers[uni->numPointers].size;
+		ptr = &uni->pointers[uni->numPointers];
+		if (ptr->sys == NULL) {
+			uni->numHoles--;
+			continue;
+		}
+		slot = FindSlot(uni, ptr->sys);
+		if (slot != UINT32_MAX) {
+			uni->index[slot] = INDEX_DELETED;
+		}
+		SysFree(ptr->sys, ptr->size);
+		uni->allocated -= ptr->size;
+		uni->stats.numFrees++;
 	}
 }
+
+void union_GetStats(const Union *uni, UnionStats *stats)
+{
+	*stats = uni->stats;
+	stats->numLive = uni->numPointers - uni->numHoles;
+	stats->allocated = uni->allocated;
+	stats->averageScan = stats->numLookups == 0 ? 0.0f :
+		(float) stats->numProbes / stats->numLookups;
+}
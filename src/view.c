@@ -1,5 +1,8 @@
 #include "gui.h"
 
+/* most views only hold themselves and their values */
+#define VIEW_ARENA 1024
+
 View *view_Create(const char *labelName, const Rect *rect)
 {
 	Label *label;
@@ -17,7 +20,7 @@ View *view_Create(const char *labelName, const Rect *rect)
 	if (uni == NULL) {
 		return NULL;
 	}
-	union_Init(uni, SIZE_MAX);
+	union_InitArena(uni, VIEW_ARENA, SIZE_MAX);
 	view = union_Alloc(uni, sizeof(*view));
 	if (view == NULL) {
 		union_Free(union_Default(), uni);
@@ -25,6 +28,13 @@ View *view_Create(const char *labelName, const Rect *rect)
 	}
 	view->label = label;
 	view->uni = uni;
+	view->flags = 0;
+	view->gcCycle = 0;
+	view->timer = 0;
+	memset(&view->list, 0, sizeof(view->list));
+	view->cache = NULL;
+	view->cacheValid = false;
+	view->cacheUsed = 0;
 	view->rect = *rect;
 	if (label->numProperties != 0) {
 		view->values = union_Alloc(uni, sizeof(*view->values) *
@@ -45,25 +55,84 @@ View *view_Create(const char *labelName, const Rect *rect)
 	view->next = NULL;
 	view->child = NULL;
 	view->parent = NULL;
+	if (view_GetBoolProperty(view, "record")) {
+		view->flags |= VIEW_FLAG_RECORD;
+	}
+	if (view_GetBoolProperty(view, "cached")) {
+		view->flags |= VIEW_FLAG_CACHED;
+	}
 	label->proc(view, EVENT_CREATE, NULL);
 	return view;
 }
 
-int view_SendRecursive(View *view, event_t type, EventInfo *info)
+static const char *event_names[] = {
+	[EVENT_NULL] = "null",
+	[CEXEC_DESTROY] = "cexec_destroy",
+	[EVENT_SERIALIZE] = "serialize",
+	[EVENT_DESERIALIZE] = "deserialize",
+	[EVENT_ADDCHILD] = "addchild",
+	[EVENT_REMCHILD] = "remchild",
+	[EVENT_ID] = "id",
+	[EVENT_GETCLIP] = "getclip",
+	[EVENT_GETCONTAINERCLIP] = "getcontainerclip",
+	[EVENT_CREATE] = "create",
+	[EVENT_COMMAND] = "command",
+	[EVENT_DESTROY] = "destroy",
+	[EVENT_TIMER] = "timer",
+	[EVENT_SETFOCUS] = "setfocus",
+	[EVENT_KILLFOCUS] = "killfocus",
+	[EVENT_PAINT] = "paint",
+	[EVENT_SIZE] = "size",
+	[EVENT_KEYDOWN] = "keydown",
+	[EVENT_CHAR] = "char",
+	[EVENT_KEYUP] = "keyup",
+	[EVENT_BUTTONDOWN] = "buttondown",
+	[EVENT_BUTTONUP] = "buttonup",
+	[EVENT_MOUSEMOVE] = "mousemove",
+	[EVENT_MOUSEMOVEOUTSIDE] = "mousemoveoutside",
+	[EVENT_CAPTUREDMOVE] = "capturedmove",
+	[EVENT_SETCURSOR] = "setcursor",
+	[EVENT_MOUSEWHEEL] = "mousewheel",
+	[EVENT_TEXTINPUT] = "textinput",
+};
+
+static int Send(View *view, event_t type, EventInfo *info)
+{
+	int r;
+
+	if (!trace_IsRunning()) {
+		return view->label->proc(view, type, info);
+	}
+	/* the global label has no name */
+	trace_Begin("dispatch", view->label->name[0] == '\0' ? "global" :
+			view->label->name, event_names[type]);
+	r = view->label->proc(view, type, info);
+	trace_End();
+	return r;
+}
+
+static void SendRecursive(View *view, event_t type, EventInfo *info)
 {
 	for (; view != NULL; view = view->next) {
-		view_SendRecursive(view->child, type, info);
+		SendRecursive(view->child, type, info);
 		/* TODO: keep this if? */
 		if (view->label != NULL) {
-			view->label->proc(view, type, info);
+			Send(view, type, info);
 		}
 	}
+}
+
+int view_SendRecursive(View *view, event_t type, EventInfo *info)
+{
+	trace_Begin("dispatch", "SendRecursive", event_names[type]);
+	SendRecursive(view, type, info);
+	trace_End();
 	return 0;
 }
 
 int view_Send(View *view, event_t type, EventInfo *info)
 {
-	return view->label->proc(view, type, info);
+	return Send(view, type, info);
 }
 
 Value *view_GetProperty(View *view, type_t type, const char *name)
@@ -97,8 +166,91 @@ int view_GetColorProperty(View *view, const char *name, rgb_t *rgb)
 	return 0;
 }
 
+bool view_ContainsPoint(View *view, const Point *p)
+{
+	Point rel;
+
+	if (!rect_Contains(&view->rect, p)) {
+		return false;
+	}
+	if (view->region == NULL) {
+		return true;
+	}
+	rel.x = p->x - view->rect.x;
+	rel.y = p->y - view->rect.y;
+	return region_ContainsPoint(view->region, &rel);
+}
+
+static bool IsShown(View *view)
+{
+	return view->parent != NULL || view == view_Default();
+}
+
+/* the view and all cached views around it have to draw again */
+static void Drop(View *view)
+{
+	renderer_DropList(&view->list);
+	for (; view != NULL; view = view->parent) {
+		view->cacheValid = false;
+	}
+}
+
+void view_Invalidate(View *view)
+{
+	Drop(view);
+	if (!IsShown(view)) {
+		return;
+	}
+	gui_Invalidate(rect_IsEmpty(&view->rect) ? NULL : &view->rect);
+}
+
+void view_InvalidateRect(View *view, const Rect *rect)
+{
+	Rect r;
+
+	Drop(view);
+	if (!IsShown(view)) {
+		return;
+	}
+	r = *rect;
+	r.x += view->rect.x;
+	r.y += view->rect.y;
+	if (!rect_IsEmpty(&view->rect) && !rect_Intersect(&r, &view->rect, &r)) {
+		return;
+	}
+	gui_Invalidate(&r);
+}
+
+void view_SetTimer(View *view, Uint32 ms)
+{
+	view->timer = SDL_GetPerformanceCounter() +
+		SDL_GetPerformanceFrequency() * ms / 1000;
+	gui_WakeAt(view->timer);
+}
+
+void view_KillTimer(View *view)
+{
+	view->timer = 0;
+}
+
+static void DropLists(View *view)
+{
+	for (; view != NULL; view = view->next) {
+		DropLists(view->child);
+		renderer_DropList(&view->list);
+		view->cacheValid = false;
+	}
+}
+
+void view_InvalidateAll(void)
+{
+	DropLists(view_Default());
+	gui_Invalidate(NULL);
+}
+
 int view_SetParent(View *view, View *parent)
 {
+	view_Invalidate(view);
 	/* isolate the child from... */
 	/* ...previous parent */
 	if (view->parent != NULL && view->parent->child == view) {
@@ -123,6 +275,7 @@ int view_SetParent(View *view, View *parent)
 		view->prev = parent->child;
 	}
 	parent->child = view;
+	view_Invalidate(view);
 	return 0;
 }
 
@@ -130,7 +283,9 @@ void view_Delete(View *view)
 {
 	Union *uni;
 
-	view_SetParent(NULL, view);
+	view_SetParent(view, NULL);
+	renderer_FreeList(&view->list);
+	gui_FreeCache(view);
 	uni = view->uni;
 	union_FreeAll(uni);
 	union_Free(union_Default(), uni);
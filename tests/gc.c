@@ -0,0 +1,132 @@
+#include "test.h"
+
+/* garbage made by a function has to be collected while everything that
+ * is reachable from a property survives, also through containers the
+ * parser made and containers that get their first buffer while the
+ * collector is marking */
+
+static const char *script =
+	"kept = string \"\"\n"
+	"str = string \"\"\n"
+	"arr = array []\n"
+	"empty = array []\n"
+	"big = array []\n"
+	"box = array []\n"
+	"fill = function {\n"
+	"	big = dup(empty)\n"
+	"	local i = 0\n"
+	"	while i < 4000 {\n"
+	"		insert(big, 0, \"x\")\n"
+	"		i = i + 1\n"
+	"	}\n"
+	"	box = dup(empty)\n"
+	"}\n"
+	"grow = function {\n"
+	"	insert(box, 0, 7)\n"
+	"}\n"
+	"main = function {\n"
+	"	local i = 0\n"
+	"	while i < 1000 {\n"
+	"		local s = dup(\"garbage\")\n"
+	"		insert(s, 0, \"more \")\n"
+	"		i = i + 1\n"
+	"	}\n"
+	"	kept = dup(\"kept\")\n"
+	"	insert(kept, 4, \"!\")\n"
+	"	insert(str, 0, \"hello\")\n"
+	"	insert(arr, 0, 42)\n"
+	"}\n"
+	/* globals are only found from a function when the last label
+	 * is not the global one */
+	"Other:\n"
+	"	:x = int 0\n";
+
+extern Union environment_union;
+
+static Value *FindGlobal(Label *glob, const char *name)
+{
+	for (Uint32 i = 0; i < glob->numProperties; i++) {
+		if (strcmp(glob->properties[i].name, name) == 0) {
+			return &glob->properties[i].value;
+		}
+	}
+	printf("missing global %s\n", name);
+	exit(1);
+}
+
+int main(void)
+{
+	Union uni;
+	RawWrapper *wrappers;
+	Uint32 numWrappers;
+	Value *main, *kept, *str, *arr, *box;
+	Value result;
+	Size before;
+
+	if (prop_ParseString(script, &uni, &wrappers, &numWrappers) < 0 ||
+			environment_Digest(wrappers, numWrappers) < 0) {
+		printf("could not load the script\n");
+		return 1;
+	}
+	union_FreeAll(&uni);
+
+	Label *const glob = environment_FindLabel("");
+	main = FindGlobal(glob, "main");
+	kept = FindGlobal(glob, "kept");
+	str = FindGlobal(glob, "str");
+	arr = FindGlobal(glob, "arr");
+	box = FindGlobal(glob, "box");
+	if (function_Execute(FindGlobal(glob, "fill")->func, NULL, 0,
+				&result) < 0 ||
+			function_Execute(main->func, NULL, 0, &result) < 0) {
+		printf("could not run main\n");
+		return 1;
+	}
+
+	before = environment_union.allocated;
+	/* the roots are scanned last to first, box is black long before
+	 * the elements of big run out the budget */
+	environment_GC(1);
+	if (function_Execute(FindGlobal(glob, "grow")->func, NULL, 0,
+				&result) < 0) {
+		printf("could not run grow\n");
+		return 1;
+	}
+	environment_GC(0);
+	if (environment_union.allocated >= before) {
+		printf("nothing was collected (%zu bytes)\n", before);
+		return 1;
+	}
+	if (kept->s->length != 5 || memcmp(kept->s->data, "kept!", 5) != 0) {
+		printf("reachable string was collected\n");
+		return 1;
+	}
+	if (!union_HasPointer(&environment_union, str->s->data) ||
+			str->s->length != 5 ||
+			memcmp(str->s->data, "hello", 5) != 0) {
+		printf("buffer of a parsed string was collected\n");
+		return 1;
+	}
+	if (!union_HasPointer(&environment_union, arr->a->values) ||
+			arr->a->numValues != 1 ||
+			arr->a->values[0].type != TYPE_INTEGER ||
+			arr->a->values[0].i != 42) {
+		printf("buffer of a parsed array was collected\n");
+		return 1;
+	}
+	if (!union_HasPointer(&environment_union, box->a->values) ||
+			box->a->numValues != 1 ||
+			box->a->values[0].i != 7) {
+		printf("buffer inserted while marking was collected\n");
+		return 1;
+	}
+	/* a second cycle has nothing left to do */
+	before = environment_union.allocated;
+	environment_GC(0);
+	if (environment_union.allocated != before) {
+		printf("second cycle collected reachable memory\n");
+		return 1;
+	}
+	printf("gc ok: %zu bytes left\n", environment_union.allocated);
+	return 0;
+}
@@ -0,0 +1,187 @@
+#include "test.h"
+
+/* paints without a display and checks the frame that was read back */
+
+static Uint32 box_color = 0xff0000;
+
+int BoxProc(View *view, event_t type, EventInfo *info)
+{
+	(void) info;
+	switch (type) {
+	case EVENT_PAINT:
+		renderer_SetDrawColor(box_color);
+		renderer_FillRect(&view->rect);
+		break;
+	default:
+	}
+	return 0;
+}
+
+/* strips keep their color while they are not damaged */
+static Uint32 strip_color = 0x0000ff;
+
+int StripProc(View *view, event_t type, EventInfo *info)
+{
+	(void) info;
+	switch (type) {
+	case EVENT_PAINT:
+		renderer_SetDrawColor(strip_color);
+		renderer_FillRect(&view->rect);
+		break;
+	default:
+	}
+	return 0;
+}
+
+static Uint32 GetPixel(SDL_Surface *surface, Sint32 x, Sint32 y)
+{
+	const Uint8 *const row = (Uint8*) surface->pixels + y * surface->pitch;
+
+	return ((const Uint32*) row)[x] & 0xffffff;
+}
+
+static int CheckFrame(const char *name, Uint32 inside)
+{
+	SDL_Surface *surface;
+	Uint32 in, out;
+
+	surface = gui_ReadFrame();
+	if (surface == NULL) {
+		printf("%s: could not read the frame\n", name);
+		return -1;
+	}
+	in = GetPixel(surface, 20, 20);
+	out = GetPixel(surface, 60, 40);
+	SDL_FreeSurface(surface);
+	if (in != inside || out != 0) {
+		printf("%s: expected %06x and 000000, got %06x and %06x\n",
+				name, inside, in, out);
+		return -1;
+	}
+	return 0;
+}
+
+/* damage in two places must not touch the view between them */
+static int CheckStrips(void)
+{
+	static const Uint32 expected[3] = { 0xffffff, 0x0000ff, 0xffffff };
+	Label *label;
+	View *strips[3];
+	SDL_Surface *surface;
+	Uint32 pixel;
+
+	label = environment_AddLabel("Strip");
+	if (label == NULL) {
+		printf("failed environment_AddLabel()\n");
+		return -1;
+	}
+	label->proc = StripProc;
+	for (Uint32 i = 0; i < 3; i++) {
+		strips[i] = view_Create("Strip",
+				&(Rect) { i * 30, 50, 20, 10 });
+		if (strips[i] == NULL) {
+			printf("failed view_Create()\n");
+			return -1;
+		}
+		view_SetParent(strips[i], view_Default());
+	}
+	gui_Step();
+
+	strip_color = 0xffffff;
+	view_Invalidate(strips[0]);
+	view_Invalidate(strips[2]);
+	gui_Step();
+
+	surface = gui_ReadFrame();
+	if (surface == NULL) {
+		printf("strips: could not read the frame\n");
+		return -1;
+	}
+	for (Uint32 i = 0; i < 3; i++) {
+		pixel = GetPixel(surface, i * 30 + 10, 55);
+		if (pixel != expected[i]) {
+			printf("strip %u: expected %06x, got %06x\n",
+					i, expected[i], pixel);
+			SDL_FreeSurface(surface);
+			return -1;
+		}
+	}
+	/* the cleared gap between two strips is opaque black */
+	pixel = ((const Uint32*) ((Uint8*) surface->pixels +
+				55 * surface->pitch))[25];
+	if (pixel != 0xff000000) {
+		printf("gap: expected ff000000, got %08x\n", pixel);
+		SDL_FreeSurface(surface);
+		return -1;
+	}
+	SDL_FreeSurface(surface);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Label *label;
+	View *view;
+	FrameStats stats;
+
+	gui_SetInitSize(80, 60);
+	if (gui_Init(GUI_INIT_HEADLESS) != 0) {
+		printf("failed gui_init()\n");
+		return 1;
+	}
+	if (gui_GetWindowWidth() != 80 || gui_GetWindowHeight() != 60) {
+		printf("framebuffer has the wrong size\n");
+		return 1;
+	}
+
+	label = environment_AddLabel("Box");
+	if (label == NULL) {
+		printf("failed environment_AddLabel()\n");
+		return 1;
+	}
+	label->proc = BoxProc;
+	view = view_Create("Box", &(Rect) { 10, 10, 30, 30 });
+	if (view == NULL) {
+		printf("failed view_Create()\n");
+		return 1;
+	}
+	view_SetParent(view, view_Default());
+
+	gui_Step();
+	if (CheckFrame("first frame", 0xff0000) < 0) {
+		return 1;
+	}
+
+	/* nothing is painted without damage */
+	box_color = 0x00ff00;
+	gui_Step();
+	if (CheckFrame("undamaged frame", 0xff0000) < 0) {
+		return 1;
+	}
+
+	view_Invalidate(view);
+	gui_Step();
+	if (CheckFrame("damaged frame", 0x00ff00) < 0) {
+		return 1;
+	}
+
+	/* every step is a frame, whether it painted or not */
+	gui_GetFrameStats(&stats);
+	if (stats.numFrames != 3 ||
+			stats.total.max < stats.phases[FRAME_PHASE_PAINT].max) {
+		printf("frame stats are wrong\n");
+		return 1;
+	}
+
+	if (CheckStrips() < 0) {
+		return 1;
+	}
+
+	if (argc > 1 && gui_SaveFrame(argv[1]) < 0) {
+		printf("could not save %s\n", argv[1]);
+		return 1;
+	}
+	gui_Quit();
+	printf("headless ok\n");
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include "test.h"
+
+/* the SSE2 and AVX2 rect kernels have to give what the scalar ones give,
+ * also for lengths that leave a tail after the last full vector */
+
+#define MAX_RECTS 300
+#define ROUNDS 20
+
+static Uint64 seed_state = 0x9e3779b97f4a7c15;
+
+static Uint32 Random(void)
+{
+	seed_state ^= seed_state << 13;
+	seed_state ^= seed_state >> 7;
+	seed_state ^= seed_state << 17;
+	return seed_state >> 32;
+}
+
+static Sint32 RandomIn(Sint32 min, Sint32 max)
+{
+	return min + (Sint32) (Random() % (Uint32) (max - min + 1));
+}
+
+static Rect RandomRect(void)
+{
+	/* empty and negative sizes included */
+	return (Rect) {
+		RandomIn(-500, 500), RandomIn(-500, 500),
+		RandomIn(-10, 300), RandomIn(-10, 300)
+	};
+}
+
+static Sint32 storage[2][4][MAX_RECTS];
+
+static RectArray MakeArray(Uint32 which, Uint32 n)
+{
+	return (RectArray) {
+		storage[which][0], storage[which][1],
+		storage[which][2], storage[which][3], n
+	};
+}
+
+struct results {
+	Uint32 mask[(MAX_RECTS + 31) / 32];
+	Uint32 numOverlaps;
+	Sint32 out[4][MAX_RECTS];
+	Uint32 numIntersections;
+	/* the same in place */
+	Sint32 inPlace[4][MAX_RECTS];
+	Uint32 numInPlace;
+	Rect bounds;
+	bool hasBounds;
+};
+
+static void Run(const Rect *rect, const RectArray *arr, struct results *res)
+{
+	RectArray out, copy;
+
+	memset(res, 0, sizeof(*res));
+	res->numOverlaps = rect_OverlapMask(rect, arr, res->mask);
+
+	out = (RectArray) {
+		res->out[0], res->out[1], res->out[2], res->out[3],
+		arr->numRects
+	};
+	res->numIntersections = rect_IntersectMany(rect, arr, &out);
+
+	copy = MakeArray(1, arr->numRects);
+	memcpy(copy.x, arr->x, sizeof(*arr->x) * arr->numRects);
+	memcpy(copy.y, arr->y, sizeof(*arr->y) * arr->numRects);
+	memcpy(copy.w, arr->w, sizeof(*arr->w) * arr->numRects);
+	memcpy(copy.h, arr->h, sizeof(*arr->h) * arr->numRects);
+	res->numInPlace = rect_IntersectMany(rect, &copy, &copy);
+	memcpy(res->inPlace[0], copy.x, sizeof(*copy.x) * copy.numRects);
+	memcpy(res->inPlace[1], copy.y, sizeof(*copy.y) * copy.numRects);
+	memcpy(res->inPlace[2], copy.w, sizeof(*copy.w) * copy.numRects);
+	memcpy(res->inPlace[3], copy.h, sizeof(*copy.h) * copy.numRects);
+
+	res->hasBounds = rect_BoundsOf(arr, &res->bounds);
+}
+
+static int Compare(const char *name, Uint32 n, const struct results *a,
+		const struct results *b)
+{
+	if (memcmp(a->mask, b->mask, sizeof(*a->mask) * ((n + 31) / 32)) != 0 ||
+			a->numOverlaps != b->numOverlaps) {
+		printf("%s: overlap mask differs for %u rects\n", name, n);
+		return -1;
+	}
+	for (Uint32 c = 0; c < 4; c++) {
+		if (memcmp(a->out[c], b->out[c], sizeof(*a->out[c]) * n) != 0 ||
+				memcmp(a->inPlace[c], b->inPlace[c],
+					sizeof(*a->inPlace[c]) * n) != 0) {
+			printf("%s: intersections differ for %u rects\n",
+					name, n);
+			return -1;
+		}
+	}
+	if (a->numIntersections != b->numIntersections ||
+			a->numInPlace != b->numInPlace) {
+		printf("%s: intersection count differs for %u rects\n",
+				name, n);
+		return -1;
+	}
+	if (a->hasBounds != b->hasBounds || (a->hasBounds &&
+			memcmp(&a->bounds, &b->bounds, sizeof(a->bounds)) != 0)) {
+		printf("%s: bounds differ for %u rects\n", name, n);
+		return -1;
+	}
+	return 0;
+}
+
+static const struct variant {
+	const char *name;
+	Uint32 kernels;
+} variants[] = {
+	{ "sse2", RECT_KERNELS_SSE2 },
+	{ "avx2", RECT_KERNELS_AVX2 },
+};
+
+int main(void)
+{
+	static struct results expected, actual;
+	RectArray arr;
+	Rect rect;
+	Uint32 numChecked[ARRLEN(variants)] = { 0 };
+
+	for (Uint32 round = 0; round < ROUNDS; round++) {
+		/* every length up to a few vectors and then some longer ones
+		 * with and without a tail */
+		for (Uint32 n = 0; n < MAX_RECTS;
+				n = n < 40 ? n + 1 : n * 2 + round % 8) {
+			arr = MakeArray(0, n);
+			for (Uint32 i = 0; i < n; i++) {
+				rect = RandomRect();
+				arr.x[i] = rect.x;
+				arr.y[i] = rect.y;
+				arr.w[i] = rect.w;
+				arr.h[i] = rect.h;
+			}
+			rect = RandomRect();
+
+			rect_SetKernels(RECT_KERNELS_SCALAR);
+			Run(&rect, &arr, &expected);
+			for (Uint32 v = 0; v < ARRLEN(variants); v++) {
+				if (rect_SetKernels(variants[v].kernels) < 0) {
+					continue;
+				}
+				Run(&rect, &arr, &actual);
+				if (Compare(variants[v].name, n, &expected,
+							&actual) < 0) {
+					return 1;
+				}
+				numChecked[v]++;
+			}
+		}
+	}
+	rect_SetKernels(RECT_KERNELS_AUTO);
+	for (Uint32 v = 0; v < ARRLEN(variants); v++) {
+		if (numChecked[v] == 0) {
+			printf("%s is not supported here\n", variants[v].name);
+		}
+	}
+	printf("rect ok\n");
+	return 0;
+}
@@ -5,6 +5,7 @@ void do_stuff(void)
 	Union uni;
 	Region *reg1, *reg2;
 	Region *reg;
+	Region stack;
 
 	union_Init(&uni, SIZE_MAX);
 
@@ -19,6 +20,11 @@ void do_stuff(void)
 	reg = region_Create_u(&uni);
 	region_Intersect(reg, reg1, reg2);
 
+	/* small results stay inside the region and need no allocation */
+	region_Init(&stack, &uni);
+	region_Subtract(&stack, reg1, reg2);
+	region_SetEmpty(&stack);
+
 	union_FreeAll(&uni);
 }
 
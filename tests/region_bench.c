@@ -0,0 +1,563 @@
+#include "test.h"
+
+/* headless timing of the region operations on seeded random workloads
+ *
+ * usage: region_bench [csv|json] [seed] [max rects]
+ *
+ * every operation runs once with regions kept in rects and once with
+ * results turned into bitmaps whenever they can be, so that the limits
+ * of region_SetBitmapLimits() can be checked against both
+ *
+ * every result up to ORACLE_RECTS input rects is also checked against
+ * the input rects at every pixel around the inputs and the result, the
+ * program fails on a mismatch */
+
+#define ORACLE_RECTS 10000
+/* each measurement repeats the operation for at least this long */
+#define MIN_TIME_NS 50000000
+#define MAX_REPS 10000
+/* the bitmap path is skipped for inputs whose bitmap would be bigger */
+#define MAX_BITMAP_WORDS (1 << 22)
+
+enum {
+	WORK_SPARSE,
+	WORK_DENSE,
+	WORK_OVERLAPPING,
+	WORK_FRAGMENTED,
+	WORK_MAX
+};
+
+static const char *work_names[WORK_MAX] = {
+	[WORK_SPARSE] = "sparse",
+	[WORK_DENSE] = "dense",
+	[WORK_OVERLAPPING] = "overlapping",
+	[WORK_FRAGMENTED] = "fragmented",
+};
+
+enum {
+	OP_ADD,
+	OP_INTERSECT,
+	OP_SUBTRACT,
+	OP_INVERT,
+	OP_MOVE_BY,
+	OP_MAX
+};
+
+static const char *op_names[OP_MAX] = {
+	[OP_ADD] = "add",
+	[OP_INTERSECT] = "intersect",
+	[OP_SUBTRACT] = "subtract",
+	[OP_INVERT] = "invert",
+	[OP_MOVE_BY] = "move_by",
+};
+
+enum {
+	PATH_RECTS,
+	PATH_BITMAP,
+	PATH_MAX
+};
+
+static const struct path {
+	const char *name;
+	Uint32 minRects;
+	Uint32 wordsPerRect;
+} paths[PATH_MAX] = {
+	[PATH_RECTS] = { "rects", UINT32_MAX, 0 },
+	[PATH_BITMAP] = { "bitmap", 0, UINT32_MAX },
+};
+
+static const Uint32 sizes[] = { 10, 100, 1000, 10000, 100000 };
+static bool json;
+static bool first = true;
+
+static Uint64 seed_state;
+
+/* xorshift so that the same seed gives the same rects everywhere */
+static Uint32 Random(void)
+{
+	seed_state ^= seed_state << 13;
+	seed_state ^= seed_state >> 7;
+	seed_state ^= seed_state << 17;
+	return seed_state >> 32;
+}
+
+static Sint32 RandomIn(Sint32 min, Sint32 max)
+{
+	return min + (Sint32) (Random() % (Uint32) (max - min + 1));
+}
+
+static void MakeRects(Uint32 work, Rect *rects, Uint32 n)
+{
+	Sint32 side;
+	Sint32 cols;
+
+	/* the area grows with the number of rects so that the density
+	 * of a workload stays the same */
+	side = 16;
+	while ((Uint32) side * side < n * 256) {
+		side *= 2;
+	}
+	cols = side / 2;
+	for (Uint32 i = 0; i < n; i++) {
+		Rect *const r = &rects[i];
+
+		switch (work) {
+		case WORK_SPARSE:
+			r->x = RandomIn(0, side * 4);
+			r->y = RandomIn(0, side * 4);
+			r->w = RandomIn(1, 8);
+			r->h = RandomIn(1, 8);
+			break;
+		case WORK_DENSE:
+			r->x = RandomIn(0, side);
+			r->y = RandomIn(0, side);
+			r->w = RandomIn(4, 20);
+			r->h = RandomIn(4, 20);
+			break;
+		case WORK_OVERLAPPING:
+			r->x = RandomIn(0, side);
+			r->y = RandomIn(0, side);
+			r->w = RandomIn(side / 8, side / 2);
+			r->h = RandomIn(side / 8, side / 2);
+			break;
+		case WORK_FRAGMENTED:
+			/* single pixels, one somewhere in each 2x2 cell */
+			r->x = (Sint32) (i % cols) * 2 + RandomIn(0, 1);
+			r->y = (Sint32) (i / cols) * 2 + RandomIn(0, 1);
+			r->w = 1;
+			r->h = 1;
+			break;
+		}
+	}
+}
+
+static Region *MakeRegion(Region *reg, const Rect *rects, Uint32 n)
+{
+	reg->rects = union_Alloc(reg->uni, sizeof(*rects) * n);
+	if (reg->rects == NULL) {
+		return NULL;
+	}
+	memcpy(reg->rects, rects, sizeof(*rects) * n);
+	reg->numRects = n;
+	return region_Optimize(reg);
+}
+
+static void Extend(Rect *frame, const Rect *r)
+{
+	const Sint32 x2 = MAX(frame->x + frame->w, r->x + r->w);
+	const Sint32 y2 = MAX(frame->y + frame->h, r->y + r->h);
+
+	frame->x = MIN(frame->x, r->x);
+	frame->y = MIN(frame->y, r->y);
+	frame->w = x2 - frame->x;
+	frame->h = y2 - frame->y;
+}
+
+static Rect BoundsOf(const Rect *rects, Uint32 n)
+{
+	Rect bounds = rects[0];
+
+	for (Uint32 i = 1; i < n; i++) {
+		Extend(&bounds, &rects[i]);
+	}
+	return bounds;
+}
+
+/* the coverage of rects inside a frame, one row at a time from the top;
+ * a rect adds one to a difference array at its left and removes it at
+ * its right while the row is inside of it, so the rects are never
+ * walked per pixel */
+typedef struct sweep {
+	const Rect *rects;
+	Uint32 n;
+	/* indices ordered by the top and by the bottom */
+	Uint32 *tops;
+	Uint32 *bottoms;
+	Uint32 nextTop;
+	Uint32 nextBottom;
+	Rect frame;
+	Sint32 *delta;
+	bool *row;
+} Sweep;
+
+static const Rect *sort_rects;
+
+static int CompareTops(const void *a, const void *b)
+{
+	const Rect *const r1 = &sort_rects[*(const Uint32*) a];
+	const Rect *const r2 = &sort_rects[*(const Uint32*) b];
+
+	return (r1->y > r2->y) - (r1->y < r2->y);
+}
+
+static int CompareBottoms(const void *a, const void *b)
+{
+	const Rect *const r1 = &sort_rects[*(const Uint32*) a];
+	const Rect *const r2 = &sort_rects[*(const Uint32*) b];
+
+	return (r1->y + r1->h > r2->y + r2->h) -
+		(r1->y + r1->h < r2->y + r2->h);
+}
+
+static int SweepInit(Sweep *sweep, Union *uni, const Rect *rects, Uint32 n,
+		const Rect *frame)
+{
+	memset(sweep, 0, sizeof(*sweep));
+	sweep->rects = rects;
+	sweep->n = n;
+	sweep->frame = *frame;
+	sweep->tops = union_Alloc(uni, sizeof(*sweep->tops) * (n + 1));
+	sweep->bottoms = union_Alloc(uni, sizeof(*sweep->bottoms) * (n + 1));
+	sweep->delta = union_Alloc(uni, sizeof(*sweep->delta) *
+			(frame->w + 1));
+	sweep->row = union_Alloc(uni, sizeof(*sweep->row) * frame->w);
+	if (sweep->tops == NULL || sweep->bottoms == NULL ||
+			sweep->delta == NULL || sweep->row == NULL) {
+		return -1;
+	}
+	memset(sweep->delta, 0, sizeof(*sweep->delta) * (frame->w + 1));
+	for (Uint32 i = 0; i < n; i++) {
+		sweep->tops[i] = i;
+		sweep->bottoms[i] = i;
+	}
+	sort_rects = rects;
+	qsort(sweep->tops, n, sizeof(*sweep->tops), CompareTops);
+	qsort(sweep->bottoms, n, sizeof(*sweep->bottoms), CompareBottoms);
+	return 0;
+}
+
+static void SweepFree(Sweep *sweep, Union *uni)
+{
+	union_Free(uni, sweep->tops);
+	union_Free(uni, sweep->bottoms);
+	union_Free(uni, sweep->delta);
+	union_Free(uni, sweep->row);
+}
+
+/* rows have to be asked for in increasing order */
+static const bool *SweepRow(Sweep *sweep, Sint32 y)
+{
+	const Sint32 x = sweep->frame.x;
+	const Rect *r;
+	Sint32 count = 0;
+
+	for (; sweep->nextTop < sweep->n; sweep->nextTop++) {
+		r = &sweep->rects[sweep->tops[sweep->nextTop]];
+		if (r->y > y) {
+			break;
+		}
+		sweep->delta[r->x - x]++;
+		sweep->delta[r->x + r->w - x]--;
+	}
+	for (; sweep->nextBottom < sweep->n; sweep->nextBottom++) {
+		r = &sweep->rects[sweep->bottoms[sweep->nextBottom]];
+		if (r->y + r->h > y) {
+			break;
+		}
+		sweep->delta[r->x - x]--;
+		sweep->delta[r->x + r->w - x]++;
+	}
+	for (Sint32 i = 0; i < sweep->frame.w; i++) {
+		count += sweep->delta[i];
+		sweep->row[i] = count > 0;
+	}
+	return sweep->row;
+}
+
+/* compares the result of an operation with what the input rects say at
+ * every pixel of their bounds and of the result, the result is
+ * converted to plain rects so that the region queries are not part of
+ * the oracle */
+static int CheckResult(Uint32 op, Region *result,
+		const Rect *a, const Rect *b, Uint32 n, Sint32 dx, Sint32 dy)
+{
+	Union *const uni = result->uni;
+	Rect bounds, frame, other;
+	Rect *shifted;
+	Sweep sa, sb, sr;
+	const bool *pa, *pb, *pr;
+	bool p, expect;
+	int status = 0;
+
+	if (region_ToRects(result) == NULL) {
+		return -1;
+	}
+	/* a moved region is compared with moved input rects */
+	shifted = union_Alloc(uni, sizeof(*shifted) * n);
+	if (shifted == NULL) {
+		return -1;
+	}
+	for (Uint32 i = 0; i < n; i++) {
+		shifted[i] = a[i];
+		shifted[i].x += dx;
+		shifted[i].y += dy;
+	}
+	bounds = BoundsOf(a, n);
+	frame = bounds;
+	other = BoundsOf(b, n);
+	Extend(&frame, &other);
+	other = BoundsOf(shifted, n);
+	Extend(&frame, &other);
+	if (result->numRects > 0) {
+		other = BoundsOf(result->rects, result->numRects);
+		Extend(&frame, &other);
+	}
+	/* one pixel of margin catches results that spill over */
+	frame.x--;
+	frame.y--;
+	frame.w += 2;
+	frame.h += 2;
+
+	if (SweepInit(&sa, uni, op == OP_MOVE_BY ? shifted : a, n,
+				&frame) < 0 ||
+			SweepInit(&sb, uni, b, n, &frame) < 0 ||
+			SweepInit(&sr, uni, result->rects, result->numRects,
+				&frame) < 0) {
+		return -1;
+	}
+	for (Sint32 y = frame.y; y < frame.y + frame.h && status == 0; y++) {
+		pa = SweepRow(&sa, y);
+		pb = SweepRow(&sb, y);
+		pr = SweepRow(&sr, y);
+		for (Sint32 i = 0; i < frame.w; i++) {
+			const Sint32 x = frame.x + i;
+
+			p = pa[i];
+			switch (op) {
+			case OP_ADD:
+				expect = p || pb[i];
+				break;
+			case OP_INTERSECT:
+				expect = p && pb[i];
+				break;
+			case OP_SUBTRACT:
+				expect = p && !pb[i];
+				break;
+			case OP_INVERT:
+				expect = !p && x >= bounds.x && y >= bounds.y &&
+					x < bounds.x + bounds.w &&
+					y < bounds.y + bounds.h;
+				break;
+			default:
+				expect = p;
+				break;
+			}
+			if (pr[i] != expect) {
+				fprintf(stderr, "%s is wrong at %d, %d\n",
+						op_names[op], x, y);
+				status = -1;
+				break;
+			}
+		}
+	}
+	SweepFree(&sa, uni);
+	SweepFree(&sb, uni);
+	SweepFree(&sr, uni);
+	union_Free(uni, shifted);
+	return status;
+}
+
+/* the difference is taken first, scaling the counter itself overflows
+ * with a frequency of 1 GHz */
+static double NsSince(Uint64 start)
+{
+	return (double) (SDL_GetPerformanceCounter() - start) * 1e9 /
+		SDL_GetPerformanceFrequency();
+}
+
+static Region *RunOp(Uint32 op, Region *dst, Region *reg1,
+		const Region *reg2, Uint32 rep)
+{
+	/* moving back and forth keeps the coordinates small */
+	const Sint32 d = rep % 2 == 0 ? 7 : -7;
+
+	switch (op) {
+	case OP_ADD:
+		return region_Add(dst, reg1, reg2);
+	case OP_INTERSECT:
+		return region_Intersect(dst, reg1, reg2);
+	case OP_SUBTRACT:
+		return region_Subtract(dst, reg1, reg2);
+	case OP_INVERT:
+		return region_Invert(dst, reg1);
+	}
+	return region_MoveBy(reg1, d, d);
+}
+
+/* times one operation on fresh regions and prints a row */
+static int Measure(Uint32 work, Uint32 path, Uint32 op, const Rect *rectsA,
+		const Rect *rectsB, Uint32 n, Region *a, Region *b,
+		Region *result)
+{
+	Region empty;
+	Uint64 start;
+	double elapsed;
+	Uint32 reps;
+
+	/* the inputs are built as rects, building them as bitmaps would
+	 * make a bitmap for every step, and only then converted */
+	region_SetBitmapLimits(paths[PATH_RECTS].minRects,
+			paths[PATH_RECTS].wordsPerRect);
+	if (MakeRegion(a, rectsA, n) == NULL ||
+			MakeRegion(b, rectsB, n) == NULL) {
+		printf("could not build the regions\n");
+		return -1;
+	}
+	region_SetBitmapLimits(paths[path].minRects, paths[path].wordsPerRect);
+	region_Init(&empty, a->uni);
+	if (region_Add(a, a, &empty) == NULL ||
+			region_Add(b, b, &empty) == NULL) {
+		printf("could not convert the regions\n");
+		return -1;
+	}
+	reps = 0;
+	start = SDL_GetPerformanceCounter();
+	do {
+		if (RunOp(op, result, a, b, reps) == NULL) {
+			printf("%s failed\n", op_names[op]);
+			return -1;
+		}
+		reps++;
+		elapsed = NsSince(start);
+	} while (elapsed < MIN_TIME_NS && reps < MAX_REPS);
+
+	Region *const out = op == OP_MOVE_BY ? a : result;
+	/* an odd number of moves leaves it shifted */
+	const Sint32 d = reps % 2 == 1 ? 7 : 0;
+	const Uint32 numOut = out->bits != NULL ? 0 : out->numRects;
+	if (json) {
+		printf("%s\n\t{ \"workload\": \"%s\", \"op\": \"%s\", "
+			"\"path\": \"%s\", \"rects\": %u, "
+			"\"result_rects\": %u, \"bitmap\": %s, "
+			"\"reps\": %u, \"ns_per_op\": %.1f }",
+			first ? "" : ",", work_names[work], op_names[op],
+			paths[path].name, n, numOut,
+			out->bits != NULL ? "true" : "false",
+			reps, elapsed / reps);
+	} else {
+		printf("%s,%s,%s,%u,%u,%d,%u,%.1f\n",
+			work_names[work], op_names[op], paths[path].name,
+			n, numOut, out->bits != NULL, reps,
+			elapsed / reps);
+	}
+	first = false;
+	/* moving back and forth must not widen the bitmap */
+	if (out->bits != NULL && out->frame.w > out->bounds.w + 128) {
+		fprintf(stderr, "%s widened the bitmap to %d for %d\n",
+				op_names[op], out->frame.w, out->bounds.w);
+		return -1;
+	}
+	if (n <= ORACLE_RECTS && CheckResult(op, out, rectsA, rectsB, n,
+				d, d) < 0) {
+		return -1;
+	}
+	region_SetEmpty(a);
+	region_SetEmpty(b);
+	region_SetEmpty(result);
+	return 0;
+}
+
+static int Usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [csv|json] [seed] [max rects]\n", name);
+	return 2;
+}
+
+static int ParseNumber(const char *str, Uint64 *number)
+{
+	char *end;
+
+	if (*str < '0' || *str > '9') {
+		return -1;
+	}
+	errno = 0;
+	*number = strtoull(str, &end, 10);
+	if (errno != 0 || *end != '\0') {
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Uint32 maxRects = 100000;
+	Union uni;
+	Rect *rectsA, *rectsB;
+	Region a, b, result;
+	Rect bounds, other;
+	Uint64 number;
+
+	seed_state = 0x9e3779b97f4a7c15;
+	if (argc > 4) {
+		return Usage(argv[0]);
+	}
+	if (argc > 1) {
+		if (strcmp(argv[1], "json") == 0) {
+			json = true;
+		} else if (strcmp(argv[1], "csv") != 0) {
+			return Usage(argv[0]);
+		}
+	}
+	if (argc > 2) {
+		if (ParseNumber(argv[2], &number) < 0) {
+			return Usage(argv[0]);
+		}
+		seed_state ^= number;
+	}
+	if (argc > 3) {
+		if (ParseNumber(argv[3], &number) < 0 || number == 0 ||
+				number > UINT32_MAX) {
+			return Usage(argv[0]);
+		}
+		maxRects = number;
+	}
+
+	union_Init(&uni, SIZE_MAX);
+	rectsA = union_Alloc(&uni, sizeof(*rectsA) * maxRects);
+	rectsB = union_Alloc(&uni, sizeof(*rectsB) * maxRects);
+	if (rectsA == NULL || rectsB == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+	region_Init(&a, &uni);
+	region_Init(&b, &uni);
+	region_Init(&result, &uni);
+
+	if (json) {
+		printf("[");
+	} else {
+		printf("workload,op,path,rects,result_rects,bitmap,reps,"
+			"ns_per_op\n");
+	}
+	for (Uint32 w = 0; w < WORK_MAX; w++) {
+		for (Uint32 s = 0; s < ARRLEN(sizes) && sizes[s] <= maxRects;
+				s++) {
+			const Uint32 n = sizes[s];
+
+			MakeRects(w, rectsA, n);
+			MakeRects(w, rectsB, n);
+			bounds = BoundsOf(rectsA, n);
+			other = BoundsOf(rectsB, n);
+			Extend(&bounds, &other);
+			for (Uint32 path = 0; path < PATH_MAX; path++) {
+				if (path == PATH_BITMAP && (Uint64) (bounds.w /
+						64 + 2) * bounds.h >
+						MAX_BITMAP_WORDS) {
+					continue;
+				}
+				for (Uint32 op = 0; op < OP_MAX; op++) {
+					if (Measure(w, path, op, rectsA, rectsB,
+							n, &a, &b,
+							&result) < 0) {
+						return 1;
+					}
+				}
+			}
+		}
+	}
+	if (json) {
+		printf("\n]\n");
+	}
+	union_FreeAll(&uni);
+	return 0;
+}
@@ -0,0 +1,261 @@
+#include "test.h"
+
+/* checks the union bookkeeping against a plain array of pointers */
+
+#define NUM_LIVE 4096
+
+static void *live[NUM_LIVE];
+static Size sizes[NUM_LIVE];
+static Uint32 num_live;
+
+static int Check(Union *uni)
+{
+	Size total = 0;
+
+	for (Uint32 i = 0; i < num_live; i++) {
+		if (!union_HasPointer(uni, live[i])) {
+			printf("lost pointer %p\n", live[i]);
+			return -1;
+		}
+		total += sizes[i];
+	}
+	if (total != uni->allocated) {
+		printf("allocated is %zu but should be %zu\n",
+				uni->allocated, total);
+		return -1;
+	}
+	return 0;
+}
+
+static int TestArena(void)
+{
+	Union uni;
+	char *str, *other;
+	Uint32 numPtrs;
+
+	union_InitArena(&uni, 1024, 4096);
+
+	/* growing the last allocation happens in place */
+	str = union_Alloc(&uni, 8);
+	strcpy(str, "arena");
+	other = union_Realloc(&uni, str, 64);
+	if (other != str || strcmp(other, "arena") != 0) {
+		printf("arena realloc moved the last allocation\n");
+		return -1;
+	}
+
+	numPtrs = uni.numPointers;
+	for (Uint32 i = 0; i < 100; i++) {
+		if (union_Alloc(&uni, 24) == NULL) {
+			return -1;
+		}
+	}
+	/* a realloc in the middle has to copy */
+	other = union_Realloc(&uni, str, 128);
+	if (other == NULL || strcmp(other, "arena") != 0) {
+		printf("arena realloc lost data\n");
+		return -1;
+	}
+	/* the copy is above the mark so freeing it is refused */
+	union_Trim(&uni, numPtrs);
+	if (uni.allocated != 64 + 100 * 24 + 128 ||
+			strcmp(other, "arena") != 0) {
+		printf("arena trim freed a moved pointer\n");
+		return -1;
+	}
+
+	numPtrs = uni.numPointers;
+	for (Uint32 i = 0; i < 20; i++) {
+		if (union_Alloc(&uni, 24) == NULL) {
+			return -1;
+		}
+	}
+	union_Trim(&uni, numPtrs);
+	if (uni.allocated != 64 + 100 * 24 + 128 ||
+			!union_HasPointer(&uni, other)) {
+		printf("arena trim left %zu bytes\n", uni.allocated);
+		return -1;
+	}
+
+	if (union_Alloc(&uni, 8192) != NULL) {
+		printf("arena ignored the limit\n");
+		return -1;
+	}
+	union_FreeAll(&uni);
+	if (uni.allocated != 0 || uni.chunks != NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+static int TestSlab(void)
+{
+	Union uni;
+	void *ptr, *other;
+
+	union_Init(&uni, SIZE_MAX);
+	/* small objects reuse the slot that was freed last */
+	ptr = union_Alloc(&uni, sizeof(Region));
+	union_Free(&uni, ptr);
+	other = union_Alloc(&uni, sizeof(Region));
+	if (ptr != other) {
+		printf("slab slot was not reused\n");
+		return -1;
+	}
+	/* same size class, nothing to move */
+	if (union_Realloc(&uni, other, sizeof(Region) + 1) != other) {
+		printf("slab realloc moved within the size class\n");
+		return -1;
+	}
+	if (uni.allocated != sizeof(Region) + 1) {
+		return -1;
+	}
+	union_FreeAll(&uni);
+	return 0;
+}
+
+static int TestFrame(void)
+{
+	Union *const uni = union_Frame();
+	void *first, *again;
+
+	/* the first frame needs more than one chunk... */
+	for (Uint32 i = 0; i < 1000; i++) {
+		union_Alloc(uni, 100);
+	}
+	union_Reset(uni);
+	first = union_Alloc(uni, 100);
+	for (Uint32 i = 0; i < 999; i++) {
+		union_Alloc(uni, 100);
+	}
+	/* ...but afterwards everything fits in the same memory */
+	union_Reset(uni);
+	again = union_Alloc(uni, 100);
+	if (first != again || uni->allocated != 100) {
+		printf("frame union did not reuse its memory\n");
+		return -1;
+	}
+	union_Reset(uni);
+	return 0;
+}
+
+static int TestStats(void)
+{
+	Union uni;
+	UnionStats stats;
+	void *ptr;
+
+	union_Init(&uni, SIZE_MAX);
+	ptr = union_Alloc(&uni, 100);
+	ptr = union_Realloc(&uni, ptr, 1000);
+	union_Alloc(&uni, 10);
+	union_Free(&uni, ptr);
+	union_GetStats(&uni, &stats);
+	if (stats.numAllocs != 2 || stats.numReallocs != 1 ||
+			stats.numFrees != 1 || stats.numLive != 1 ||
+			stats.peakAllocated != 1010 || stats.allocated != 10) {
+		printf("wrong union statistics\n");
+		return -1;
+	}
+	union_FreeAll(&uni);
+	return 0;
+}
+
+static int TestMark(void)
+{
+	Union uni;
+	void *below[200];
+	Uint32 mark;
+
+	union_Init(&uni, SIZE_MAX);
+	for (Uint32 i = 0; i < ARRLEN(below); i++) {
+		below[i] = union_Alloc(&uni, 8);
+	}
+	mark = union_Mark(&uni);
+	for (Uint32 i = 0; i < 10; i++) {
+		union_Alloc(&uni, 16);
+	}
+	/* enough holes to compact, which would renumber the pointers */
+	for (Uint32 i = 0; i < 150; i++) {
+		union_Free(&uni, below[i]);
+	}
+	union_Trim(&uni, mark);
+	union_Unmark(&uni);
+	if (uni.allocated != 50 * 8) {
+		printf("trim after compacting left %zu bytes\n",
+				uni.allocated);
+		return -1;
+	}
+	for (Uint32 i = 150; i < ARRLEN(below); i++) {
+		if (!union_HasPointer(&uni, below[i])) {
+			printf("trim after compacting freed a pointer below"
+					" the mark\n");
+			return -1;
+		}
+	}
+	/* without a mark, holes are compacted again */
+	union_Free(&uni, below[150]);
+	if (uni.numHoles != 0) {
+		printf("holes were not compacted after the mark\n");
+		return -1;
+	}
+	union_FreeAll(&uni);
+	return 0;
+}
+
+int main(void)
+{
+	Union uni;
+	Uint32 numPtrs;
+	void *ptr;
+
+	union_Init(&uni, SIZE_MAX);
+	srand(0);
+	for (Uint32 i = 0; i < 1000000; i++) {
+		const Uint32 r = rand() % 10;
+		const Uint32 j = num_live == 0 ? 0 : rand() % num_live;
+		const Size sz = 1 + rand() % 100;
+
+		if (r < 4 && num_live < NUM_LIVE) {
+			live[num_live] = union_Alloc(&uni, sz);
+			sizes[num_live++] = sz;
+		} else if (r < 7 && num_live > 0) {
+			if (union_Free(&uni, live[j]) < 0) {
+				return 1;
+			}
+			num_live--;
+			live[j] = live[num_live];
+			sizes[j] = sizes[num_live];
+		} else if (num_live > 0) {
+			ptr = union_Realloc(&uni, live[j], sz);
+			if (ptr == NULL) {
+				return 1;
+			}
+			live[j] = ptr;
+			sizes[j] = sz;
+		}
+		if (i % 10000 == 0 && Check(&uni) < 0) {
+			return 1;
+		}
+	}
+
+	/* rolling back must keep everything that was there before */
+	numPtrs = union_Mark(&uni);
+	for (Uint32 i = 0; i < 1000; i++) {
+		union_Alloc(&uni, 16);
+	}
+	union_Trim(&uni, numPtrs);
+	union_Unmark(&uni);
+	if (Check(&uni) < 0) {
+		return 1;
+	}
+
+	union_FreeAll(&uni);
+
+	if (TestArena() < 0 || TestSlab() < 0 || TestFrame() < 0 ||
+			TestStats() < 0 || TestMark() < 0) {
+		return 1;
+	}
+	printf("union ok\n");
+	return 0;
+}